@@ -0,0 +1,669 @@
+#ifndef _CU_ASYNC_IO_H_
+#define _CU_ASYNC_IO_H_
+
+#include <map>
+#include <deque>
+#include <vector>
+#include <string>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <condition_variable>
+#include "channel.h"
+#include "shell.h"
+#include "reader.h"
+#include "thread_channel.h"
+
+#ifdef LINUX
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+
+namespace cu {
+
+/*
+whole file reads with several files in flight, for cat() of thousands of small
+files after find(): the reads of the next files go on while the lines of the
+first one are yielded.
+
+backends: io_uring (raw syscalls, no liburing) and, where it isn't available
+(old kernel, seccomp, WIN32 ...), a pool of threads doing blocking reads.
+
+c.pipeline(find("logs"), cu::cat_async(64), grep("*error*"));
+
+cat_async waits the oldest read in the thread of the sender. with async_reader a
+cpproutine reads without blocking the scheduler, it sleeps until the completion:
+
+cu::async_reader reader(sch);
+sch.spawn([&](auto& yield) { auto r = reader.read(yield, "a.log"); ... r->data ... });
+*/
+namespace io {
+
+class read_request
+{
+public:
+	explicit read_request(const std::string& filename)
+		: filename(filename)
+		, error(0)
+		, _done(false)
+	{
+		;
+	}
+
+	bool done() const
+	{
+		return _done.load();
+	}
+
+	// blocks the thread until the read is finished
+	void wait()
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		_finished.wait(lock, [this]() { return _done.load(); });
+	}
+
+	// called by the backend, from any thread
+	void finish(int err)
+	{
+		error = err;
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_done = true;
+		}
+		_finished.notify_all();
+		if(_on_done)
+		{
+			_on_done();
+		}
+	}
+
+	std::string filename;
+	// the whole file, valid once done()
+	std::string data;
+	// errno of the failed operation, 0 if ok
+	int error;
+
+	// set before submit
+	std::function<void()> _on_done;
+
+protected:
+	std::atomic<bool> _done;
+	std::mutex _mutex;
+	std::condition_variable _finished;
+};
+
+using request_ptr = std::shared_ptr<read_request>;
+
+// blocking read of the whole file
+inline void read_file(read_request& request)
+{
+	std::unique_ptr<FILE, int(*)(FILE*)> input(fopen(request.filename.c_str(), "rb"), fclose);
+	if(!input)
+	{
+		request.finish(errno);
+		return;
+	}
+	char buff[1 << 16];
+	size_t n;
+	while((n = fread(buff, 1, sizeof(buff), input.get())) > 0)
+	{
+		request.data.append(buff, n);
+	}
+	request.finish(ferror(input.get()) ? EIO : 0);
+}
+
+class read_backend
+{
+public:
+	virtual ~read_backend() { ; }
+	// never blocks, the request is finished from other thread
+	virtual void submit(const request_ptr& request) = 0;
+	virtual const char* name() const = 0;
+};
+
+// blocking reads in depth threads
+class pool_backend : public read_backend
+{
+public:
+	explicit pool_backend(size_t depth)
+		: _stop(false)
+	{
+		for(size_t i = 0; i < std::max<size_t>(depth, 1); ++i)
+		{
+			_workers.emplace_back([this]() { _work(); });
+		}
+	}
+
+	~pool_backend()
+	{
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_stop = true;
+		}
+		_pending.notify_all();
+		for(auto& worker : _workers)
+		{
+			worker.join();
+		}
+	}
+
+	void submit(const request_ptr& request) override
+	{
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_tasks.emplace_back(request);
+		}
+		_pending.notify_one();
+	}
+
+	const char* name() const override
+	{
+		return "threads";
+	}
+
+protected:
+	void _work()
+	{
+		for(;;)
+		{
+			request_ptr request;
+			{
+				std::unique_lock<std::mutex> lock(_mutex);
+				_pending.wait(lock, [this]() { return _stop || !_tasks.empty(); });
+				if(_tasks.empty())
+					return;
+				request = std::move(_tasks.front());
+				_tasks.pop_front();
+			}
+			read_file(*request);
+		}
+	}
+
+protected:
+	bool _stop;
+	std::mutex _mutex;
+	std::condition_variable _pending;
+	std::deque<request_ptr> _tasks;
+	std::vector<std::thread> _workers;
+};
+
+#ifdef LINUX
+
+/*
+one ring of depth entries: the callers submit (under _mutex), a thread reaps the
+completions and finishes the requests. a request is OPENAT, STATX and one READV of
+the whole file, each stage is queued by the reaper when the previous one completes,
+short reads are resubmitted from the offset reached. files without a size (pipes,
+/proc ...) go to a fallback pool of threads, submit never touches the file.
+*/
+class uring_backend : public read_backend
+{
+public:
+	// throws if the kernel doesn't allow io_uring
+	explicit uring_backend(size_t depth)
+		: _depth(std::max<size_t>(depth, 1))
+		, _in_flight(0)
+		, _stop(false)
+	{
+		io_uring_params params;
+		memset(&params, 0, sizeof(params));
+		_fd = int(syscall(__NR_io_uring_setup, unsigned(_depth), &params));
+		if(_fd < 0)
+		{
+			throw std::runtime_error("io_uring_setup failed");
+		}
+		_map_rings(params);
+		if(!_supported({IORING_OP_OPENAT, IORING_OP_STATX, IORING_OP_READV}))
+		{
+			_unmap_rings();
+			close(_fd);
+			throw std::runtime_error("io_uring without openat/statx");
+		}
+		_reaper = std::thread([this]() { _reap(); });
+	}
+
+	~uring_backend()
+	{
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_stop = true;
+			// wakes up the reaper
+			_push_nop();
+		}
+		_reaper.join();
+		_unmap_rings();
+		close(_fd);
+	}
+
+	uring_backend(const uring_backend&) = delete;
+	uring_backend& operator=(const uring_backend&) = delete;
+
+	void submit(const request_ptr& request) override
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		auto& op = _ops[request.get()];
+		op.request = request;
+		op.fd = -1;
+		op.offset = 0;
+		if(_in_flight < _depth)
+		{
+			_push_open(op);
+		}
+		else
+		{
+			_waiting.emplace_back(request.get());
+		}
+	}
+
+	const char* name() const override
+	{
+		return "io_uring";
+	}
+
+protected:
+	enum class stage
+	{
+		opening,
+		stating,
+		reading
+	};
+
+	struct operation
+	{
+		request_ptr request;
+		stage step;
+		int fd;
+		size_t offset;
+		iovec iov;
+		struct statx info;
+	};
+
+	// IORING_REGISTER_PROBE is 5.6, the same kernel than openat and statx
+	bool _supported(std::initializer_list<int> opcodes)
+	{
+		const unsigned max_ops = 256;
+		std::vector<char> buffer(sizeof(io_uring_probe) + max_ops * sizeof(io_uring_probe_op), 0);
+		auto probe = reinterpret_cast<io_uring_probe*>(buffer.data());
+		if(syscall(__NR_io_uring_register, _fd, IORING_REGISTER_PROBE, probe, max_ops) < 0)
+		{
+			return false;
+		}
+		for(int opcode : opcodes)
+		{
+			if((opcode > probe->last_op) || !(probe->ops[opcode].flags & IO_URING_OP_SUPPORTED))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	void _unmap_rings()
+	{
+		munmap(_sqes, _sqes_size);
+		if(_cq_ptr != _sq_ptr)
+		{
+			munmap(_cq_ptr, _cq_size);
+		}
+		munmap(_sq_ptr, _sq_size);
+	}
+
+	void _map_rings(const io_uring_params& params)
+	{
+		_sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+		_cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+		bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+		if(single)
+		{
+			_sq_size = _cq_size = std::max(_sq_size, _cq_size);
+		}
+		_sq_ptr = mmap(nullptr, _sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQ_RING);
+		_cq_ptr = single ? _sq_ptr : mmap(nullptr, _cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_CQ_RING);
+		_sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+		_sqes = static_cast<io_uring_sqe*>(mmap(nullptr, _sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQES));
+		if((_sq_ptr == MAP_FAILED) || (_cq_ptr == MAP_FAILED) || (_sqes == MAP_FAILED))
+		{
+			close(_fd);
+			throw std::runtime_error("io_uring mmap failed");
+		}
+		char* sq = static_cast<char*>(_sq_ptr);
+		_sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+		_sq_mask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+		_sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+		char* cq = static_cast<char*>(_cq_ptr);
+		_cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+		_cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+		_cq_mask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+		_cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+	}
+
+	// with _mutex, the kernel takes the sqe in io_uring_enter: the sq never fills
+	void _push_sqe(const io_uring_sqe& sqe)
+	{
+		unsigned tail = *_sq_tail;
+		unsigned index = tail & _sq_mask;
+		_sqes[index] = sqe;
+		_sq_array[index] = index;
+		__atomic_store_n(_sq_tail, tail + 1, __ATOMIC_RELEASE);
+		syscall(__NR_io_uring_enter, _fd, 1, 0, 0, nullptr, 0);
+	}
+
+	void _push_open(operation& op)
+	{
+		op.step = stage::opening;
+		io_uring_sqe sqe;
+		memset(&sqe, 0, sizeof(sqe));
+		sqe.opcode = IORING_OP_OPENAT;
+		sqe.fd = AT_FDCWD;
+		sqe.addr = reinterpret_cast<uint64_t>(op.request->filename.c_str());
+		sqe.open_flags = O_RDONLY | O_CLOEXEC;
+		sqe.user_data = reinterpret_cast<uint64_t>(op.request.get());
+		++_in_flight;
+		_push_sqe(sqe);
+	}
+
+	void _push_stat(operation& op)
+	{
+		op.step = stage::stating;
+		io_uring_sqe sqe;
+		memset(&sqe, 0, sizeof(sqe));
+		sqe.opcode = IORING_OP_STATX;
+		sqe.fd = op.fd;
+		sqe.addr = reinterpret_cast<uint64_t>("");
+		sqe.len = STATX_TYPE | STATX_SIZE;
+		sqe.off = reinterpret_cast<uint64_t>(&op.info);
+		sqe.statx_flags = AT_EMPTY_PATH;
+		sqe.user_data = reinterpret_cast<uint64_t>(op.request.get());
+		++_in_flight;
+		_push_sqe(sqe);
+	}
+
+	void _push_read(operation& op)
+	{
+		op.step = stage::reading;
+		op.iov.iov_base = &op.request->data[op.offset];
+		op.iov.iov_len = op.request->data.size() - op.offset;
+		io_uring_sqe sqe;
+		memset(&sqe, 0, sizeof(sqe));
+		sqe.opcode = IORING_OP_READV;
+		sqe.fd = op.fd;
+		sqe.off = op.offset;
+		sqe.addr = reinterpret_cast<uint64_t>(&op.iov);
+		sqe.len = 1;
+		sqe.user_data = reinterpret_cast<uint64_t>(op.request.get());
+		++_in_flight;
+		_push_sqe(sqe);
+	}
+
+	void _push_nop()
+	{
+		io_uring_sqe sqe;
+		memset(&sqe, 0, sizeof(sqe));
+		sqe.opcode = IORING_OP_NOP;
+		sqe.user_data = 0;
+		_push_sqe(sqe);
+	}
+
+	void _reap()
+	{
+		for(;;)
+		{
+			syscall(__NR_io_uring_enter, _fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+			std::vector<request_ptr> finished;
+			std::vector<int> errors;
+			bool stop = false;
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				unsigned head = *_cq_head;
+				while(head != __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE))
+				{
+					io_uring_cqe cqe = _cqes[head & _cq_mask];
+					++head;
+					if(cqe.user_data == 0)
+					{
+						continue;
+					}
+					--_in_flight;
+					auto it = _ops.find(reinterpret_cast<read_request*>(cqe.user_data));
+					operation& op = it->second;
+					if((op.step == stage::opening) && (cqe.res >= 0))
+					{
+						op.fd = cqe.res;
+						_push_stat(op);
+						continue;
+					}
+					if((op.step == stage::stating) && (cqe.res >= 0))
+					{
+						if(!S_ISREG(op.info.stx_mode) || (op.info.stx_size == 0))
+						{
+							// unknown size (pipes, /proc ...): a blocking read in other thread
+							close(op.fd);
+							_fallback_pool().submit(op.request);
+							_ops.erase(it);
+							continue;
+						}
+						op.request->data.resize(size_t(op.info.stx_size));
+						_push_read(op);
+						continue;
+					}
+					if((cqe.res > 0) && (op.offset + size_t(cqe.res) < op.request->data.size()))
+					{
+						// short read
+						op.offset += size_t(cqe.res);
+						_push_read(op);
+						continue;
+					}
+					if(cqe.res >= 0)
+					{
+						// the file can be shorter than at statx
+						op.request->data.resize(op.offset + size_t(cqe.res));
+					}
+					if(op.fd >= 0)
+					{
+						close(op.fd);
+					}
+					finished.emplace_back(std::move(op.request));
+					errors.emplace_back(cqe.res < 0 ? -cqe.res : 0);
+					_ops.erase(it);
+				}
+				__atomic_store_n(_cq_head, head, __ATOMIC_RELEASE);
+				while((_in_flight < _depth) && !_waiting.empty())
+				{
+					_push_open(_ops[_waiting.front()]);
+					_waiting.pop_front();
+				}
+				stop = _stop && _ops.empty();
+			}
+			// out of the lock, finish can resume a cpproutine or a waiting thread
+			for(size_t i = 0; i < finished.size(); ++i)
+			{
+				finished[i]->finish(errors[i]);
+			}
+			if(stop)
+			{
+				return;
+			}
+		}
+	}
+
+	// with _mutex, only the reaper uses it
+	pool_backend& _fallback_pool()
+	{
+		if(!_fallback)
+		{
+			_fallback.reset(new pool_backend(1));
+		}
+		return *_fallback;
+	}
+
+protected:
+	size_t _depth;
+	size_t _in_flight;
+	bool _stop;
+	int _fd;
+	std::mutex _mutex;
+	// created by the reaper, its pending reads are finished when it is destroyed
+	std::unique_ptr<pool_backend> _fallback;
+	std::map<read_request*, operation> _ops;
+	std::deque<read_request*> _waiting;
+	std::thread _reaper;
+	void* _sq_ptr;
+	void* _cq_ptr;
+	size_t _sq_size;
+	size_t _cq_size;
+	size_t _sqes_size;
+	io_uring_sqe* _sqes;
+	unsigned* _sq_tail;
+	unsigned* _sq_array;
+	unsigned _sq_mask;
+	unsigned* _cq_head;
+	unsigned* _cq_tail;
+	unsigned _cq_mask;
+	io_uring_cqe* _cqes;
+};
+
+#endif
+
+// io_uring if the kernel allows it, else threads
+inline std::shared_ptr<read_backend> make_backend(size_t depth, bool uring = true)
+{
+#ifdef LINUX
+	if(uring)
+	{
+		try
+		{
+			return std::make_shared<uring_backend>(depth);
+		}
+		catch(std::runtime_error&)
+		{
+			;
+		}
+	}
+#endif
+	return std::make_shared<pool_backend>(depth);
+}
+
+}
+
+class async_reader
+{
+public:
+	explicit async_reader(cu::parallel_scheduler& sche, size_t depth = 32, bool uring = true)
+		: _sche(sche)
+		, _backend(io::make_backend(depth, uring))
+	{
+		;
+	}
+
+	const char* backend() const
+	{
+		return _backend->name();
+	}
+
+	// starts the read, the cpproutine can submit more before waiting any
+	io::request_ptr submit(const std::string& filename)
+	{
+		auto request = std::make_shared<io::read_request>(filename);
+		auto waiters = std::make_shared<detail::coroutine_waiters>(_sche);
+		_waiters[request.get()] = waiters;
+		request->_on_done = [waiters]() { waiters->notify(); };
+		_backend->submit(request);
+		return request;
+	}
+
+	// the cpproutine sleeps until the completion, the others go on
+	void wait(cu::yield_type& yield, const io::request_ptr& request)
+	{
+		auto waiters = _waiters[request.get()];
+		while(!waiters->wait(yield, [&request]() { return request->done(); }))
+		{
+			;
+		}
+		_waiters.erase(request.get());
+	}
+
+	io::request_ptr read(cu::yield_type& yield, const std::string& filename)
+	{
+		auto request = submit(filename);
+		wait(yield, request);
+		return request;
+	}
+
+protected:
+	cu::parallel_scheduler& _sche;
+	std::shared_ptr<io::read_backend> _backend;
+	// only touched by the scheduler thread
+	std::map<io::read_request*, std::shared_ptr<detail::coroutine_waiters> > _waiters;
+};
+
+/*
+like cat(), each input line is a filename, with up to depth files read ahead.
+lines are yielded in input order, the files that can't be read are skipped (same as cat).
+a link has no access to the yield of the sender, so when the oldest file isn't read yet
+the thread of the sender waits for it (as cat() waits its fread): the overlap is between
+the reads in flight and the lines yielded, not with other cpproutines. a cpproutine that
+must not stop the scheduler uses async_reader.
+*/
+ch_str::link cat_async(size_t depth = 32, bool uring = true)
+{
+	// the backend (ring or threads) lives as long as the link
+	auto backend = io::make_backend(depth, uring);
+	depth = std::max<size_t>(depth, 1);
+	return [backend, depth](ch_str::in& source, ch_str::out& yield)
+	{
+		std::deque<io::request_ptr> ahead;
+		std::string line;
+		auto emit_oldest = [&]()
+		{
+			io::request_ptr request = std::move(ahead.front());
+			ahead.pop_front();
+			request->wait();
+			if(request->error != 0)
+			{
+				return;
+			}
+			auto split = [&](const char* data, size_t length, const std::shared_ptr<const void>&) {
+				line.assign(data, length);
+				yield(line);
+			};
+			const char* begin = request->data.data();
+			cu::detail::_split_all(begin, begin + request->data.size(), std::shared_ptr<const void>(), split);
+		};
+		for (auto& s : source)
+		{
+			if(s)
+			{
+				ahead.emplace_back(std::make_shared<io::read_request>(*s));
+				backend->submit(ahead.back());
+				if(ahead.size() >= depth)
+				{
+					emit_oldest();
+				}
+			}
+			else
+			{
+				while(!ahead.empty())
+				{
+					emit_oldest();
+				}
+				yield(s);
+			}
+		}
+		while(!ahead.empty())
+		{
+			emit_oldest();
+		}
+	};
+}
+
+}
+
+#endif
+
@@ -0,0 +1,351 @@
+#ifndef _CU_BLOCK_H_
+#define _CU_BLOCK_H_
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <boost/bind.hpp>
+#include <boost/regex.hpp>
+#include "channel.h"
+#include "shell.h"
+
+namespace cu {
+
+/*
+up to max_lines lines stored contiguously: one byte buffer plus an offset table.
+a channel of blocks pays the channel hop once per block instead of once per line.
+*/
+class line_block
+{
+public:
+	static const size_t max_lines = 4096;
+
+	line_block()
+		: _offsets(1, 0)
+	{
+		;
+	}
+
+	// a block with only one line, lets ch_block be fed like ch_str: c("file.log")
+	line_block(const std::string& line)
+		: _offsets(1, 0)
+	{
+		push_back(line);
+	}
+
+	line_block(const char* line)
+		: _offsets(1, 0)
+	{
+		push_back(line, strlen(line));
+	}
+
+	void push_back(const char* line, size_t length)
+	{
+		_data.append(line, length);
+		_offsets.push_back(uint32_t(_data.size()));
+	}
+
+	void push_back(const std::string& line)
+	{
+		push_back(line.data(), line.size());
+	}
+
+	const char* data(size_t i) const
+	{
+		return _data.data() + _offsets[i];
+	}
+
+	size_t length(size_t i) const
+	{
+		return _offsets[i + 1] - _offsets[i];
+	}
+
+	std::string line(size_t i) const
+	{
+		return std::string(data(i), length(i));
+	}
+
+	size_t size() const
+	{
+		return _offsets.size() - 1;
+	}
+
+	bool empty() const
+	{
+		return size() == 0;
+	}
+
+	bool full() const
+	{
+		return size() >= max_lines;
+	}
+
+	void clear()
+	{
+		_data.clear();
+		_offsets.resize(1);
+	}
+
+protected:
+	std::string _data;
+	std::vector<uint32_t> _offsets;
+};
+
+using ch_block = cu::channel<line_block>;
+
+namespace block {
+
+namespace detail {
+
+	// accumulate lines and yield full blocks, call flush() at the end of the stream
+	class packer
+	{
+	public:
+		explicit packer(ch_block::out& yield)
+			: _yield(yield)
+		{
+			;
+		}
+
+		void operator()(const char* line, size_t length)
+		{
+			_block.push_back(line, length);
+			if(_block.full())
+			{
+				flush();
+			}
+		}
+
+		void operator()(const std::string& line)
+		{
+			operator()(line.data(), line.size());
+		}
+
+		void flush()
+		{
+			if(!_block.empty())
+			{
+				_yield(_block);
+				_block.clear();
+			}
+		}
+
+	protected:
+		ch_block::out& _yield;
+		line_block _block;
+	};
+
+	// field-th token, consecutive delimiters are merged (same as cu::cut)
+	inline bool token(const char* line, size_t length, int field, const char* delim, const char*& first, size_t& n)
+	{
+		const char* end = line + length;
+		const char* p = line;
+		int i = 0;
+		while(p < end)
+		{
+			while((p < end) && strchr(delim, *p))
+				++p;
+			if(p == end)
+				break;
+			const char* begin = p;
+			while((p < end) && !strchr(delim, *p))
+				++p;
+			if(i++ == field)
+			{
+				first = begin;
+				n = p - begin;
+				return true;
+			}
+		}
+		return false;
+	}
+}
+
+ch_block::link cat(const std::string& filename)
+{
+	return [=](ch_block::in&, ch_block::out& yield)
+	{
+		detail::packer pack(yield);
+		read_lines(filename, [&](const char* data, size_t length, const std::shared_ptr<const void>&) {
+			pack(data, length);
+		});
+		pack.flush();
+	};
+}
+
+// each line of the input blocks is a filename
+ch_block::link cat()
+{
+	return [&](ch_block::in& source, ch_block::out& yield)
+	{
+		for (auto& s : source)
+		{
+			if(s)
+			{
+				for(size_t i = 0; i < (*s).size(); ++i)
+				{
+					cat((*s).line(i))(source, yield);
+				}
+			}
+			else
+			{
+				yield(s);
+			}
+		}
+	};
+}
+
+ch_block::link grep(const char* pattern, bool exclusion = false)
+{
+	return [=](ch_block::in& source, ch_block::out& yield)
+	{
+		const boost::regex re(translate(pattern));
+		boost::match_results<const char*> groups;
+		for (auto& s : source)
+		{
+			if(s)
+			{
+				const line_block& lines(*s);
+				line_block matched;
+				for(size_t i = 0; i < lines.size(); ++i)
+				{
+					const char* line = lines.data(i);
+					if ((boost::regex_search(line, line + lines.length(i), groups, re) && (groups.size() > 0)) == !exclusion)
+					{
+						matched.push_back(line, lines.length(i));
+					}
+				}
+				if(!matched.empty())
+				{
+					yield(matched);
+				}
+			}
+			else
+			{
+				yield(s);
+			}
+		}
+	};
+}
+
+ch_block::link cut(int field, const char* delim = " ")
+{
+	return [=](ch_block::in& source, ch_block::out& yield)
+	{
+		for (auto& s : source)
+		{
+			if(s)
+			{
+				const line_block& lines(*s);
+				line_block fields;
+				for(size_t i = 0; i < lines.size(); ++i)
+				{
+					const char* first;
+					size_t n;
+					if(detail::token(lines.data(i), lines.length(i), field, delim, first, n))
+					{
+						fields.push_back(first, n);
+					}
+				}
+				if(!fields.empty())
+				{
+					yield(fields);
+				}
+			}
+			else
+			{
+				yield(s);
+			}
+		}
+	};
+}
+
+ch_block::link count()
+{
+	return [=](ch_block::in& source, ch_block::out& yield)
+	{
+		size_t total = 0;
+		for (auto& s : source)
+		{
+			if(s)
+			{
+				total += (*s).size();
+			}
+			else if(s.failed())
+			{
+				yield(s);
+			}
+		}
+		yield(line_block(std::to_string(total)));
+	};
+}
+
+// runs any per-line link (ch_str::link) over a stream of blocks
+ch_block::link lines(const ch_str::link& per_line)
+{
+	return [=](ch_block::in& source, ch_block::out& yield)
+	{
+		ch_str::in unpacked(
+			[&](ch_str::out& line_yield)
+			{
+				for (auto& s : source)
+				{
+					if(s)
+					{
+						for(size_t i = 0; i < (*s).size(); ++i)
+						{
+							line_yield((*s).line(i));
+						}
+					}
+					else
+					{
+						line_yield(s.template forward<std::string>());
+					}
+				}
+			}
+		);
+		ch_str::in processed(boost::bind(per_line, boost::ref(unpacked), _1));
+		detail::packer pack(yield);
+		for (auto& s : processed)
+		{
+			if(s)
+			{
+				pack(*s);
+			}
+			else
+			{
+				if(s.closed())
+				{
+					pack.flush();
+				}
+				yield(s.template forward<line_block>());
+			}
+		}
+		pack.flush();
+	};
+}
+
+ch_block::link out(std::vector<std::string>& strs)
+{
+	return [&](ch_block::in& source, ch_block::out& yield)
+	{
+		for (auto& s : source)
+		{
+			if(s)
+			{
+				for(size_t i = 0; i < (*s).size(); ++i)
+				{
+					strs.emplace_back((*s).line(i));
+				}
+			}
+			yield(s);
+		}
+	};
+}
+
+}
+
+}
+
+#endif
+
@@ -0,0 +1,213 @@
+#ifndef _CU_BROADCAST_CHANNEL_H_
+#define _CU_BROADCAST_CHANNEL_H_
+
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <coroutine/coroutine.h>
+#include "semaphore.h"
+#include "channel.h"
+
+namespace cu {
+
+/*
+one producer, many subscribers: every subscriber sees every element.
+elements live once in a shared ring, each subscriber has its own read cursor.
+by default the slowest subscriber governs the backpressure, with drop_lagging
+the producer never blocks and the oldest element is dropped for subscribers
+that fall a full ring behind.
+*/
+template <typename T>
+class broadcast_channel
+{
+public:
+	using subscriber = size_t;
+
+	explicit broadcast_channel(cu::parallel_scheduler& sche, size_t buffer = 0, bool drop_lagging = false)
+		: _sche(sche)
+		, _capacity(buffer + 1)
+		, _drop_lagging(drop_lagging)
+		, _ring(buffer + 1, optional<T>(true))
+		, _head(0)
+		, _tail(0)
+		, _slots(sche, buffer + 1)
+	{
+		;
+	}
+
+	broadcast_channel(const broadcast_channel&) = delete;
+	broadcast_channel& operator=(const broadcast_channel&) = delete;
+
+	// a new subscriber only sees the elements sent after subscribing
+	subscriber subscribe()
+	{
+		_subscriptions.emplace_back(std::make_unique<subscription>(_sche, _head));
+		return _subscriptions.size() - 1;
+	}
+
+	// stop governing the backpressure, pending elements are discarded
+	void unsubscribe(subscriber id)
+	{
+		_subscriptions[id]->active = false;
+		_advance_tail();
+	}
+
+	template <typename R>
+	void operator()(cu::yield_type& yield, const R& data)
+	{
+		T value(data);
+		_push(yield, optional<T>(value));
+	}
+
+	void close(cu::yield_type& yield)
+	{
+		_push(yield, optional<T>(true));
+	}
+
+	optional<T> get(cu::yield_type& yield, subscriber id)
+	{
+		auto& sub = *_subscriptions[id];
+		sub.elements.wait(yield);
+		optional<T> data = _ring[sub.cursor % _capacity];
+		++sub.cursor;
+		_advance_tail();
+		return data;
+	}
+
+	inline bool empty(subscriber id) const
+	{
+		return _subscriptions[id]->elements.empty();
+	}
+
+	inline bool full() const
+	{
+		return (_head - _tail) >= _capacity;
+	}
+
+	// elements lost by a subscriber in drop_lagging mode
+	size_t dropped(subscriber id) const
+	{
+		return _subscriptions[id]->dropped;
+	}
+
+	size_t subscribers() const
+	{
+		return _subscriptions.size();
+	}
+
+protected:
+	struct subscription
+	{
+		explicit subscription(cu::parallel_scheduler& sche, uint64_t head)
+			: elements(sche, 0)
+			, cursor(head)
+			, dropped(0)
+			, active(true)
+		{
+			;
+		}
+
+		cu::semaphore elements;
+		uint64_t cursor;
+		size_t dropped;
+		bool active;
+	};
+
+	void _push(cu::yield_type& yield, optional<T>&& data)
+	{
+		if(_drop_lagging)
+		{
+			if(full())
+			{
+				_drop_oldest();
+			}
+		}
+		else
+		{
+			_slots.wait(yield);
+		}
+		_ring[_head % _capacity] = std::move(data);
+		++_head;
+		for(auto& sub : _subscriptions)
+		{
+			if(sub->active)
+			{
+				sub->elements.notify();
+			}
+		}
+		if(_subscriptions.empty())
+		{
+			// nobody is listening, nothing to keep
+			_advance_tail();
+		}
+		// let the subscribers drain before the next element
+		yield( cu::control_type{} );
+	}
+
+	void _drop_oldest()
+	{
+		for(auto& sub : _subscriptions)
+		{
+			if(sub->active && (sub->cursor == _tail))
+			{
+				// count > 0, never blocks
+				sub->elements.wait();
+				++sub->cursor;
+				++sub->dropped;
+			}
+		}
+		_advance_tail();
+	}
+
+	void _advance_tail()
+	{
+		uint64_t slowest = _head;
+		for(auto& sub : _subscriptions)
+		{
+			if(sub->active)
+			{
+				slowest = std::min(slowest, sub->cursor);
+			}
+		}
+		for(; _tail < slowest; ++_tail)
+		{
+			_ring[_tail % _capacity] = optional<T>(true);
+			if(!_drop_lagging)
+			{
+				_slots.notify();
+			}
+		}
+	}
+
+protected:
+	cu::parallel_scheduler& _sche;
+	size_t _capacity;
+	bool _drop_lagging;
+	std::vector< optional<T> > _ring;
+	uint64_t _head;
+	uint64_t _tail;
+	cu::semaphore _slots;
+	std::vector< std::unique_ptr<subscription> > _subscriptions;
+};
+
+template <typename T>
+auto range(cu::yield_type& yield, cu::broadcast_channel<T>& chan, typename cu::broadcast_channel<T>::subscriber id)
+{
+	return cu::pull_type<T>(
+		[&, id](cu::push_type<T>& own_yield) {
+			for(;;)
+			{
+				auto data = chan.get(yield, id);
+				if(data)
+					own_yield(*data);
+				else
+					break; // detect close
+			}
+		}
+	);
+}
+
+}
+
+#endif
+
@@ -4,6 +4,9 @@
 #include <iostream>
 #include <vector>
 #include <stack>
+#include <queue>
+#include <map>
+#include <algorithm>
 #include <boost/bind.hpp>
 #include <coroutine/coroutine.h>
 #include "semaphore.h"
@@ -11,6 +14,10 @@
 #include <fast-event-system/async_delay.h>
 #include <assert.h>
 #include <mutex>
+#include <memory>
+#include <functional>
+#include <chrono>
+#include <string>
 
 namespace cu {
 
@@ -19,40 +26,57 @@ template <typename T> struct optional;
 
 namespace detail {
 
-	template <typename R>
-	static auto _pipe(std::vector< typename cu::link< optional<R> > >& links, R input)
+	// runs the links over input, sink(element) for each value and error element yielded by the last link
+	template <typename R, typename Sink>
+	static void _pipe_into(std::vector< typename cu::link< optional<R> > >& links, R input, Sink&& sink)
 	{
-		std::vector<R> output;
 		std::vector< typename cu::channel<R>::generator > coros;
 		coros.emplace_back( cu::make_generator< optional<R> >( [&](auto& yield) { yield(input); }) );
 		for (auto& f : links)
 		{
 			coros.emplace_back( cu::make_generator< optional<R> >(boost::bind(f, boost::ref(*coros.back().get()), _1) ) );
 		}
-		auto pipeline = {
-			[&output]() -> typename cu::channel<R>::link
+		typename cu::channel<R>::link tail = [&sink](auto& source, auto&)
+		{
+			for (auto& s : source)
 			{
-				return [&output](auto& source, auto& yield)
+				if(s || s.failed())
 				{
-					for (auto& s : source)
-					{
-						if(s)
-						{
-							output.emplace_back(*s);
-						}
-					}
-
-				};
-			}()
+					sink(s);
+				}
+			}
 		};
-		for (auto& f : pipeline)
+		coros.emplace_back( cu::make_generator< optional<R> >(boost::bind(tail, boost::ref(*coros.back().get()), _1) ) );
+		// a link can finish before its source (head, take_while, ...),
+		// unwind the suspended upstream generators now, downstream first
+		while(!coros.empty())
 		{
-			coros.emplace_back( cu::make_generator< optional<R> >(boost::bind(f, boost::ref(*coros.back().get()), _1) ) );
+			coros.pop_back();
 		}
+	}
+
+	// values and error elements yielded by the last link
+	template <typename R>
+	static auto _pipe(std::vector< typename cu::link< optional<R> > >& links, R input)
+	{
+		std::vector< optional<R> > output;
+		_pipe_into<R>(links, input, [&output](const optional<R>& s) { output.emplace_back(s); });
 		return output;
 	}
 }
 
+// why an element failed (see optional::fail)
+struct element_error
+{
+	int code;
+	std::string message;
+};
+
+/*
+value, close mark or error. close marks and errors are false, so the links
+that forward "else yield(s)" forward the errors too. the normal path only pays
+a null pointer.
+*/
 // problema: no es posible tener: channel<bool> por las ambiguedades en el constructor
 template <typename T>
 struct optional
@@ -77,8 +101,92 @@ struct optional
 		return !_invalid;
 	}
 
+	// an element that failed, it goes through the links instead of throwing
+	static optional fail(int code, const std::string& message)
+	{
+		optional e(true);
+		e._error = std::make_shared<const element_error>(element_error{code, message});
+		return e;
+	}
+
+	bool failed() const
+	{
+		return bool(_error);
+	}
+
+	bool closed() const
+	{
+		return _invalid && !_error;
+	}
+
+	const element_error& get_error() const
+	{
+		return *_error;
+	}
+
+	// the same close mark or error in a link of other type
+	template <typename U>
+	optional<U> forward() const
+	{
+		assert(_invalid);
+		optional<U> mark(true);
+		mark._error = _error;
+		return mark;
+	}
+
 	T _data;
 	bool _invalid;
+	std::shared_ptr<const element_error> _error;
+};
+
+// what a channel does with the error elements that reach it
+enum class error_policy
+{
+	raise,	// throw std::runtime_error in the sender (default), before any element of the send is delivered
+	skip	// discard them (counted in channel_stats::errors)
+};
+
+// snapshot of the instrumentation of one channel (see channel::enable_stats)
+struct channel_stats
+{
+	std::string name;
+	size_t buffer = 0;
+	// elements sent / received (close marks are not counted)
+	size_t elements_in = 0;
+	size_t elements_out = 0;
+	// occupancy[i]: times an element was pushed with i elements already waiting
+	std::vector<size_t> occupancy;
+	// time spent blocked in _slots.wait (producers) and _elements.wait (consumers)
+	std::chrono::nanoseconds producer_blocked{0};
+	std::chrono::nanoseconds consumer_blocked{0};
+	// elements stored past the memory watermark (see channel::spill), close marks are not counted
+	size_t spilled = 0;
+	// elements lost by the overflow policy (see channel::set_policy)
+	size_t dropped = 0;
+	size_t overwritten = 0;
+	size_t conflated = 0;
+	// error elements that reached the channel (see channel::on_error)
+	size_t errors = 0;
+};
+
+// what a producer does when the channel is full
+enum class overflow_policy
+{
+	block,				// wait for a free slot (default)
+	drop_newest,		// discard the element being sent
+	overwrite_oldest,	// discard the oldest element in the buffer (ring)
+	conflate			// replace the buffered element with the same key (see channel::conflate)
+};
+
+// storage for the elements past the memory watermark of a channel (see spill.h)
+template <typename T>
+class overflow_storage
+{
+public:
+	virtual ~overflow_storage() { ; }
+	virtual void push(const optional<T>& data) = 0;
+	virtual optional<T> pop() = 0;
+	virtual size_t size() const = 0;
 };
 
 template <typename T>
@@ -149,26 +257,22 @@ public:
 	template <typename R>
 	void operator()(const R& data)
 	{
-		for(auto& e : pipe(T(data)))
+		auto output = pipe(T(data));
+		_raise_before_push(output);
+		for(auto& e : output)
 		{
-			_slots.wait();
-			(*_coros.top())( optional<T>(e) );
-			_elements.notify();
+			_push(e);
 		}
 	}
 
 	template <typename R>
 	void operator()(cu::yield_type& yield, const R& data)
 	{
-		for(auto& e : pipe(T(data)))
+		auto output = pipe(T(data));
+		_raise_before_push(output);
+		for(auto& e : output)
 		{
-			_slots.wait(yield);
-			(*_coros.top())( optional<T>(e) );
-			_elements.notify(yield);
-			if(full())
-			{
-				yield( cu::control_type{} );
-			}
+			_push(yield, e);
 		}
 	}
 
@@ -188,23 +292,65 @@ public:
 		}
 	}
 
+	virtual ~channel()
+	{
+		// the pending send_after would deliver to a destroyed channel
+		for(auto& delayed : _delayed)
+		{
+			_sche.cancel(delayed.second);
+		}
+	}
+
+	/*
+	the element is delivered after delay (order by due time, not by send time).
+	it takes its slot now and enters the buffer when a timer of the scheduler is due,
+	consumers only see due elements. close waits the last delayed element.
+	*/
+	template <typename R>
+	void send_after(fes::deltatime delay, const R& data)
+	{
+		auto output = pipe(T(data));
+		_raise_before_push(output);
+		for(auto& e : output)
+		{
+			_push(e, delay);
+		}
+	}
+
+	template <typename R>
+	void send_after(cu::yield_type& yield, fes::deltatime delay, const R& data)
+	{
+		auto output = pipe(T(data));
+		_raise_before_push(output);
+		for(auto& e : output)
+		{
+			_push(yield, e, delay);
+		}
+	}
+
 	optional<T> get()
 	{
+		_count_starved();
 		_elements.wait();
-		optional<T> data = std::get<0>(_buf.get());
-		_slots.notify();
+		optional<T> data = _take();
+		_taken();
+		_record_out(data);
+		_release_slot();
 		return std::move(data);
 	}
 
 	optional<T> get(cu::yield_type& yield)
 	{
-		if(_buf.empty())
+		_count_starved();
+		if(_storage_empty())
 		{
 			yield( cu::control_type{} );
 		}
-		_elements.wait(yield);
-		optional<T> data = std::get<0>(_buf.get(yield));
-		_slots.notify(yield);
+		_wait_element(yield);
+		optional<T> data = _take(yield);
+		_taken();
+		_record_out(data);
+		_release_slot(yield);
 		return std::move(data);
 	}
 
@@ -220,21 +366,490 @@ public:
 
 	void close()
 	{
-		_slots.wait();
-		(*_coros.top())( optional<T>(true) );
+		_acquire_slot();
+		if(!_delayed.empty())
+		{
+			_deliver_at(optional<T>(true), _last_due);
+			return;
+		}
+		_send_tail(optional<T>(true));
 		_elements.notify();
 	}
 
 	void close(cu::yield_type& yield)
 	{
-		_slots.wait(yield);
-		(*_coros.top())( optional<T>(true) );
-		_elements.notify(yield);
+		_acquire_slot(yield);
+		if(!_delayed.empty())
+		{
+			_deliver_at(optional<T>(true), _last_due);
+		}
+		else
+		{
+			_send_tail(optional<T>(true));
+			_elements.notify(yield);
+		}
 		yield( cu::control_type{} );
 	}
 
+	void set_name(const std::string& name)
+	{
+		_name = name;
+	}
+
+	const std::string& get_name() const
+	{
+		return _name;
+	}
+
+	// instrumentation is off by default, enabling it resets the counters
+	void enable_stats(bool enabled = true)
+	{
+		_stats_enabled = enabled;
+		reset_stats();
+	}
+
+	void reset_stats()
+	{
+		_stats = channel_stats();
+		_stats.occupancy.assign(_buffer + 2, 0);
+	}
+
+	/*
+	overflow mode: the producer never blocks, the elements past watermark
+	are kept in storage (e.g. cu::spill_file) and read back in order.
+	*/
+	void spill(size_t watermark, std::unique_ptr< overflow_storage<T> > storage)
+	{
+		assert(watermark > 0);
+		_watermark = watermark;
+		_overflow = std::move(storage);
+	}
+
+	// close marks always block, they are never dropped
+	void set_policy(overflow_policy policy)
+	{
+		assert((policy != overflow_policy::conflate) || _same_key);
+		_policy = policy;
+	}
+
+	overflow_policy get_policy() const
+	{
+		return _policy;
+	}
+
+	void set_error_policy(error_policy policy)
+	{
+		_error_policy = policy;
+	}
+
+	// the error elements go to handler instead of the buffer (e.g. to an error channel)
+	void on_error(std::function<void(const element_error&)> handler)
+	{
+		_error_handler = std::move(handler);
+	}
+
+	// keep only the latest element per key_fn(element), the consumer sees the freshest value
+	template <typename KeyFn>
+	void conflate(KeyFn key_fn)
+	{
+		_same_key = [key_fn](const T& a, const T& b) { return key_fn(a) == key_fn(b); };
+		_policy = overflow_policy::conflate;
+	}
+
+	/*
+	auto mode: the buffer moves between min_buffer and max_buffer, measured every
+	period sends. it grows (x2) while producers fill it in more than 1/8 of the sends,
+	and shrinks (/2) while they never fill it and consumers find it empty in more
+	than half of the gets. the buffer of the constructor is the initial size.
+	*/
+	void set_adaptive(size_t min_buffer, size_t max_buffer, size_t period = 64)
+	{
+		assert((min_buffer <= max_buffer) && (period > 0));
+		_adaptive = true;
+		_min_buffer = min_buffer;
+		_max_buffer = max_buffer;
+		_adapt_period = period;
+		_sends = _blocked_sends = _starved_gets = 0;
+		_resize(std::min(std::max(_buffer, min_buffer), max_buffer));
+	}
+
+	size_t get_buffer() const
+	{
+		return _buffer;
+	}
+
+	// for the stages that wait other things than channels (sockets, timers ...)
+	cu::parallel_scheduler& get_scheduler() const
+	{
+		return _sche;
+	}
+
+	channel_stats stats() const
+	{
+		channel_stats snapshot(_stats);
+		snapshot.name = _name;
+		snapshot.buffer = _buffer;
+		return snapshot;
+	}
+
 protected:
 
+	using stats_clock = std::chrono::steady_clock;
+
+	// element already processed by the pipeline
+	void _push(const optional<T>& e, fes::deltatime delay = fes::deltatime(0))
+	{
+		if(e.failed())
+		{
+			_on_error(e.get_error());
+			return;
+		}
+		if(_apply_policy(*e))
+		{
+			return;
+		}
+		_acquire_slot();
+		_record_in();
+		if(delay > fes::deltatime(0))
+		{
+			_deliver_at(e, fes::high_resolution_clock() + delay);
+			return;
+		}
+		_send_tail(e);
+		_elements.notify();
+	}
+
+	void _push(cu::yield_type& yield, const optional<T>& e, fes::deltatime delay = fes::deltatime(0))
+	{
+		if(e.failed())
+		{
+			_on_error(e.get_error());
+			return;
+		}
+		if(_apply_policy(*e))
+		{
+			return;
+		}
+		_acquire_slot(yield);
+		_record_in();
+		if(delay > fes::deltatime(0))
+		{
+			_deliver_at(e, fes::high_resolution_clock() + delay);
+			return;
+		}
+		_send_tail(e);
+		_elements.notify(yield);
+		if(full())
+		{
+			yield( cu::control_type{} );
+		}
+	}
+
+	// raise is all or nothing: nothing of the send is delivered if one element failed
+	void _raise_before_push(const std::vector< optional<T> >& output)
+	{
+		if(_error_handler || (_error_policy != error_policy::raise))
+		{
+			return;
+		}
+		for(auto& e : output)
+		{
+			if(e.failed())
+			{
+				_on_error(e.get_error());
+			}
+		}
+	}
+
+	void _on_error(const element_error& error)
+	{
+		if(_stats_enabled)
+		{
+			++_stats.errors;
+		}
+		if(_error_handler)
+		{
+			_error_handler(error);
+		}
+		else if(_error_policy == error_policy::raise)
+		{
+			throw std::runtime_error(error.message);
+		}
+	}
+
+	// the tail runs synchronously
+	void _send_tail(const optional<T>& data)
+	{
+		(*_coros.top())( data );
+	}
+
+	// the slot is already taken, the element is stored when due (same due: send order)
+	void _deliver_at(const optional<T>& data, fes::marktime due)
+	{
+		_last_due = std::max(_last_due, due);
+		uint64_t key = _delayed_seq++;
+		_delayed[key] = _sche.call_at(due, [this, data, key]() {
+			_delayed.erase(key);
+			_send_tail(data);
+			_elements.notify();
+		});
+	}
+
+	// buffer storage, priority_channel replaces it
+	virtual void _put(const optional<T>& data)
+	{
+		_buf(0, fes::deltatime(0), data);
+	}
+
+	virtual optional<T> _take()
+	{
+		return std::get<0>(_buf.get());
+	}
+
+	virtual optional<T> _take(cu::yield_type& yield)
+	{
+		return std::get<0>(_buf.get(yield));
+	}
+
+	virtual bool _storage_empty() const
+	{
+		return _buf.empty();
+	}
+
+	// overwrite_oldest: removes the element sent first, not the next to be taken
+	virtual void _evict_oldest()
+	{
+		_take();
+	}
+
+	// true if the element is already handled (dropped or stored without a new slot)
+	bool _apply_policy(const T& e)
+	{
+		if(_overflow || (_policy == overflow_policy::block))
+		{
+			return false;
+		}
+		if((_policy == overflow_policy::conflate) && _replace_same_key(e))
+		{
+			if(_stats_enabled)
+			{
+				++_stats.conflated;
+			}
+			return true;
+		}
+		if(!full())
+		{
+			return false;
+		}
+		if(_policy == overflow_policy::drop_newest)
+		{
+			if(_stats_enabled)
+			{
+				++_stats.dropped;
+			}
+			return true;
+		}
+		if((_policy == overflow_policy::overwrite_oldest) && !_storage_empty())
+		{
+			// the slot of the oldest is reused, semaphores don't change
+			_evict_oldest();
+			--_in_memory;
+			_record_in();
+			_send_tail(optional<T>(e));
+			if(_stats_enabled)
+			{
+				++_stats.overwritten;
+			}
+			return true;
+		}
+		return false;
+	}
+
+	bool _replace_same_key(const T& e)
+	{
+		if(_storage_empty())
+		{
+			return false;
+		}
+		// the buffer is bounded and small: take all and put back in the same order
+		std::vector< optional<T> > buffered;
+		while(!_storage_empty())
+		{
+			buffered.emplace_back(_take());
+		}
+		bool replaced = false;
+		for(auto& b : buffered)
+		{
+			if(!replaced && b && _same_key(*b, e))
+			{
+				*b = e;
+				replaced = true;
+			}
+			_put(b);
+		}
+		return replaced;
+	}
+
+	void _acquire_slot()
+	{
+		if(!_overflow)
+		{
+			_count_send();
+			_slots.wait();
+		}
+	}
+
+	void _acquire_slot(cu::yield_type& yield)
+	{
+		if(!_overflow)
+		{
+			_count_send();
+			_wait_slot(yield);
+		}
+	}
+
+	void _count_send()
+	{
+		if(!_adaptive)
+		{
+			return;
+		}
+		// this send takes the last free slot or waits for one
+		if(_slots.size() <= 1)
+		{
+			++_blocked_sends;
+		}
+		if(++_sends >= _adapt_period)
+		{
+			_adapt();
+		}
+	}
+
+	void _count_starved()
+	{
+		if(_adaptive && empty())
+		{
+			++_starved_gets;
+		}
+	}
+
+	void _adapt()
+	{
+		if((_blocked_sends * 8 > _sends) && (_buffer < _max_buffer))
+		{
+			_resize(std::min(std::max<size_t>(_buffer * 2, 1), _max_buffer));
+		}
+		else if((_blocked_sends == 0) && (_starved_gets * 2 > _sends) && (_buffer > _min_buffer))
+		{
+			_resize(std::max(_buffer / 2, _min_buffer));
+		}
+		_sends = _blocked_sends = _starved_gets = 0;
+	}
+
+	// growing wakes the blocked producers, shrinking only takes the free slots
+	void _resize(size_t buffer)
+	{
+		while(_buffer < buffer)
+		{
+			++_buffer;
+			_slots.notify();
+		}
+		while((_buffer > buffer) && _slots.try_wait())
+		{
+			--_buffer;
+		}
+		if(_stats_enabled && (_stats.occupancy.size() < _buffer + 2))
+		{
+			_stats.occupancy.resize(_buffer + 2, 0);
+		}
+	}
+
+	void _release_slot()
+	{
+		if(!_overflow)
+		{
+			_slots.notify();
+		}
+	}
+
+	void _release_slot(cu::yield_type& yield)
+	{
+		if(!_overflow)
+		{
+			_slots.notify(yield);
+		}
+	}
+
+	void _store(const optional<T>& data)
+	{
+		// keep the order: once spilling, everything goes to storage until it is drained
+		if(_overflow && ((_in_memory >= _watermark) || (_overflow->size() > 0)))
+		{
+			_overflow->push(data);
+			if(_stats_enabled && data)
+			{
+				++_stats.spilled;
+			}
+		}
+		else
+		{
+			_put(data);
+			++_in_memory;
+		}
+	}
+
+	void _taken()
+	{
+		--_in_memory;
+		if(_overflow && (_overflow->size() > 0))
+		{
+			_put(_overflow->pop());
+			++_in_memory;
+		}
+	}
+
+	void _wait_slot(cu::yield_type& yield)
+	{
+		if(!_stats_enabled)
+		{
+			_slots.wait(yield);
+			return;
+		}
+		auto begin = stats_clock::now();
+		_slots.wait(yield);
+		_stats.producer_blocked += stats_clock::now() - begin;
+	}
+
+	void _wait_element(cu::yield_type& yield)
+	{
+		if(!_stats_enabled)
+		{
+			_elements.wait(yield);
+			return;
+		}
+		auto begin = stats_clock::now();
+		_elements.wait(yield);
+		_stats.consumer_blocked += stats_clock::now() - begin;
+	}
+
+	void _record_in()
+	{
+		if(_stats_enabled)
+		{
+			++_stats.elements_in;
+			size_t waiting = std::min<size_t>(std::max(_elements.size(), 0), _stats.occupancy.size() - 1);
+			++_stats.occupancy[waiting];
+		}
+	}
+
+	void _record_out(const optional<T>& data)
+	{
+		if(_stats_enabled && data)
+		{
+			++_stats.elements_out;
+		}
+	}
+
 	template <typename R>
 	auto pipe(const R& input)
 	{
@@ -247,7 +862,7 @@ protected:
 			[this](auto& source) {
 				for(auto& s : source)
 				{
-					this->_buf(0, fes::deltatime(0), s);
+					this->_store(s);
 				}
 			}
 		);
@@ -275,6 +890,115 @@ protected:
 	cu::semaphore _elements;
 	cu::semaphore _slots;
 	std::vector<link> _links;
+	std::string _name;
+	bool _stats_enabled = false;
+	channel_stats _stats;
+	size_t _in_memory = 0;
+	size_t _watermark = 0;
+	std::unique_ptr< overflow_storage<T> > _overflow;
+	overflow_policy _policy = overflow_policy::block;
+	std::function<bool(const T&, const T&)> _same_key;
+	// send_after waiting their timer: key -> timer
+	std::map<uint64_t, cu::timer_id> _delayed;
+	uint64_t _delayed_seq = 0;
+	fes::marktime _last_due{0};
+	error_policy _error_policy = error_policy::raise;
+	std::function<void(const element_error&)> _error_handler;
+	bool _adaptive = false;
+	size_t _min_buffer = 0;
+	size_t _max_buffer = 0;
+	size_t _adapt_period = 0;
+	size_t _sends = 0;
+	size_t _blocked_sends = 0;
+	size_t _starved_gets = 0;
+};
+
+/*
+the consumer gets the element with the highest priority (the greatest by Compare,
+same as std::priority_queue). equal elements are FIFO and the close mark is the last.
+send_after delays when the element enters the queue, then the order is by priority.
+*/
+template <typename T, typename Compare = std::less<T> >
+class priority_channel : public channel<T>
+{
+public:
+	explicit priority_channel(cu::parallel_scheduler& sche, size_t buffer = 0, Compare cmp = Compare())
+		: channel<T>(sche, buffer)
+		, _queue(entry_compare{cmp})
+		, _seq(0)
+	{
+		;
+	}
+
+protected:
+	struct entry
+	{
+		optional<T> data;
+		uint64_t seq;
+	};
+
+	struct entry_compare
+	{
+		// true if a goes after b
+		bool operator()(const entry& a, const entry& b) const
+		{
+			if(!a.data || !b.data)
+			{
+				return !a.data && (b.data || (a.seq > b.seq));
+			}
+			if(cmp(*a.data, *b.data))
+				return true;
+			if(cmp(*b.data, *a.data))
+				return false;
+			return a.seq > b.seq;
+		}
+
+		Compare cmp;
+	};
+
+	void _put(const optional<T>& data) override
+	{
+		_queue.push(entry{data, _seq++});
+	}
+
+	optional<T> _take() override
+	{
+		optional<T> data = _queue.top().data;
+		_queue.pop();
+		return data;
+	}
+
+	optional<T> _take(cu::yield_type&) override
+	{
+		return _take();
+	}
+
+	bool _storage_empty() const override
+	{
+		return _queue.empty();
+	}
+
+	// the lowest seq, the queue is bounded by the buffer: rebuilt without it
+	void _evict_oldest() override
+	{
+		std::vector<entry> entries;
+		entries.reserve(_queue.size());
+		while(!_queue.empty())
+		{
+			entries.emplace_back(_queue.top());
+			_queue.pop();
+		}
+		auto oldest = std::min_element(entries.begin(), entries.end(), [](const entry& a, const entry& b) { return a.seq < b.seq; });
+		entries.erase(oldest);
+		for(auto& e : entries)
+		{
+			_queue.push(e);
+		}
+	}
+
+protected:
+	std::priority_queue<entry, std::vector<entry>, entry_compare> _queue;
+	uint64_t _seq;
 };
 
 template <typename T>
@@ -392,6 +1116,86 @@ auto range(cu::yield_type& yield, cu::channel<T>& chan)
 	);
 };
 
+// yields elements from whichever channel is ready first, until all are closed
+template <typename T, typename ... Args>
+auto merge(cu::yield_type& yield, cu::channel<T>& chan, cu::channel<Args>&... chans)
+{
+	std::vector< cu::channel<T>* > inputs{&chan, &chans...};
+	return cu::pull_type<T>(
+		[&yield, inputs](cu::push_type<T>& own_yield) mutable {
+			size_t next = 0;
+			while(!inputs.empty())
+			{
+				// round robin, starting after the last channel served
+				int ready = -1;
+				for(size_t i = 0; i < inputs.size(); ++i)
+				{
+					size_t n = (next + i) % inputs.size();
+					if(!inputs[n]->empty())
+					{
+						ready = int(n);
+						break;
+					}
+				}
+				if(ready == -1)
+				{
+					yield( cu::control_type{} );
+					continue;
+				}
+				auto data = inputs[ready]->get(yield);
+				if(data)
+				{
+					next = ready + 1;
+					own_yield(*data);
+				}
+				else
+				{
+					// detect close
+					inputs.erase(inputs.begin() + ready);
+					next = ready;
+				}
+			}
+		}
+	);
+}
+
+// k-way merge of channels already sorted by cmp
+template <typename Compare, typename T, typename ... Args>
+auto merge_sorted(cu::yield_type& yield, Compare cmp, cu::channel<T>& chan, cu::channel<Args>&... chans)
+{
+	std::vector< cu::channel<T>* > inputs{&chan, &chans...};
+	return cu::pull_type<T>(
+		[&yield, cmp, inputs](cu::push_type<T>& own_yield) {
+			using head = std::pair<T, size_t>;
+			// min-heap by cmp, ties resolved by channel order
+			auto greater = [&cmp](const head& a, const head& b)
+			{
+				if(cmp(b.first, a.first))
+					return true;
+				if(cmp(a.first, b.first))
+					return false;
+				return a.second > b.second;
+			};
+			std::priority_queue<head, std::vector<head>, decltype(greater)> heap(greater);
+			for(size_t i = 0; i < inputs.size(); ++i)
+			{
+				auto data = inputs[i]->get(yield);
+				if(data)
+					heap.emplace(*data, i);
+			}
+			while(!heap.empty())
+			{
+				head top = heap.top();
+				heap.pop();
+				own_yield(top.first);
+				auto data = inputs[top.second]->get(yield);
+				if(data)
+					heap.emplace(*data, top.second);
+			}
+		}
+	);
+}
+
 }
 
 #endif
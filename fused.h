@@ -0,0 +1,328 @@
+#ifndef _CU_FUSED_H_
+#define _CU_FUSED_H_
+
+#include <string>
+#include <sstream>
+#include <boost/tokenizer.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/regex.hpp>
+#include "channel.h"
+#include "shell.h"
+
+namespace cu {
+
+/*
+stages composed at compile time: find() | grep("*.h") | cat() | count()
+each stage pushes its results to the next one with a plain call, there is not
+a coroutine or a std::function between stages and the compiler can inline all
+the chain. a fused chain converts to a ch_str::link, so it is one link more
+in channel::pipeline() and the stages that must suspend stay as normal links:
+
+c.pipeline(fused::find() | fused::grep("*.h"), run(), fused::quote() | fused::count());
+
+a stage is:
+
+struct my_stage : fused::stage<my_stage>
+{
+	template <typename Emit>
+	void operator()(const std::string& in, Emit& emit);  // emit(out) 0..n times
+
+	template <typename Emit>
+	void flush(Emit& emit);  // optional, called at the end of the stream
+};
+*/
+namespace fused {
+
+template <typename Derived>
+struct stage
+{
+	template <typename Emit>
+	void flush(Emit&)
+	{
+		;
+	}
+
+	operator ch_str::link() const
+	{
+		Derived self(static_cast<const Derived&>(*this));
+		return [self](ch_str::in& source, ch_str::out& yield)
+		{
+			// state (count, ...) is not shared between pipes
+			Derived chain(self);
+			auto emit = [&yield](const std::string& data) { yield(data); };
+			for (auto& s : source)
+			{
+				if(s)
+				{
+					chain(*s, emit);
+				}
+				else
+				{
+					yield(s);
+				}
+			}
+			chain.flush(emit);
+		};
+	}
+};
+
+template <typename A, typename B>
+class compose : public stage< compose<A, B> >
+{
+public:
+	compose(const A& a, const B& b)
+		: _a(a)
+		, _b(b)
+	{
+		;
+	}
+
+	template <typename Emit>
+	void operator()(const std::string& data, Emit& emit)
+	{
+		auto next = [this, &emit](const std::string& x) { _b(x, emit); };
+		_a(data, next);
+	}
+
+	template <typename Emit>
+	void flush(Emit& emit)
+	{
+		auto next = [this, &emit](const std::string& x) { _b(x, emit); };
+		_a.flush(next);
+		_b.flush(emit);
+	}
+
+protected:
+	A _a;
+	B _b;
+};
+
+template <typename A, typename B>
+compose<A, B> operator|(const stage<A>& a, const stage<B>& b)
+{
+	return compose<A, B>(static_cast<const A&>(a), static_cast<const B&>(b));
+}
+
+// each input is a directory, emits the files below it
+struct find : stage<find>
+{
+	template <typename Emit>
+	void operator()(const std::string& dir, Emit& emit)
+	{
+		boost::filesystem::path p(dir);
+		if (boost::filesystem::exists(p))
+		{
+			_tree(p, emit);
+		}
+	}
+
+protected:
+	template <typename Emit>
+	void _tree(const boost::filesystem::path& p, Emit& emit)
+	{
+		namespace fs = boost::filesystem;
+		if(fs::is_directory(p))
+		{
+			for (auto f = fs::directory_iterator(p); f != fs::directory_iterator(); ++f)
+			{
+				_tree(f->path(), emit);
+			}
+		}
+		else
+		{
+			emit(p.string());
+		}
+	}
+};
+
+// each input is a filename, emits its lines
+struct cat : stage<cat>
+{
+	template <typename Emit>
+	void operator()(const std::string& filename, Emit& emit)
+	{
+		std::string line;
+		read_lines(filename, [&](const char* data, size_t length, const std::shared_ptr<const void>&) {
+			line.assign(data, length);
+			emit(line);
+		});
+	}
+};
+
+struct grep : stage<grep>
+{
+	explicit grep(const char* pattern, bool exclusion = false)
+		: _re(translate(pattern))
+		, _exclusion(exclusion)
+	{
+		;
+	}
+
+	template <typename Emit>
+	void operator()(const std::string& line, Emit& emit)
+	{
+		if ((boost::regex_search(line, _groups, _re) && (_groups.size() > 0)) == !_exclusion)
+		{
+			emit(line);
+		}
+	}
+
+protected:
+	boost::regex _re;
+	bool _exclusion;
+	boost::match_results<std::string::const_iterator> _groups;
+};
+
+struct contain : stage<contain>
+{
+	explicit contain(const std::string& in)
+		: _in(in)
+	{
+		;
+	}
+
+	template <typename Emit>
+	void operator()(const std::string& line, Emit& emit)
+	{
+		if (line.find(_in) != std::string::npos)
+		{
+			emit(line);
+		}
+	}
+
+protected:
+	std::string _in;
+};
+
+struct cut : stage<cut>
+{
+	explicit cut(int field, const char* delim = " ")
+		: _field(field)
+		, _delim(delim)
+	{
+		;
+	}
+
+	template <typename Emit>
+	void operator()(const std::string& line, Emit& emit)
+	{
+		typedef boost::tokenizer<boost::char_separator<char>> tokenizer;
+		int i = 0;
+		for (auto& t : tokenizer(line, boost::char_separator<char>(_delim.c_str())))
+		{
+			if (i++ == _field)
+			{
+				emit(t);
+				break;
+			}
+		}
+	}
+
+protected:
+	int _field;
+	std::string _delim;
+};
+
+struct quote : stage<quote>
+{
+	explicit quote(const char* delim = "\"")
+		: _delim(delim)
+	{
+		;
+	}
+
+	template <typename Emit>
+	void operator()(const std::string& line, Emit& emit)
+	{
+		emit(_delim + line + _delim);
+	}
+
+protected:
+	std::string _delim;
+};
+
+struct count : stage<count>
+{
+	count()
+		: _total(0)
+	{
+		;
+	}
+
+	template <typename Emit>
+	void operator()(const std::string&, Emit&)
+	{
+		++_total;
+	}
+
+	template <typename Emit>
+	void flush(Emit& emit)
+	{
+		emit(std::to_string(_total));
+		_total = 0;
+	}
+
+protected:
+	size_t _total;
+};
+
+template <typename Function>
+struct map_stage : stage< map_stage<Function> >
+{
+	explicit map_stage(const Function& f)
+		: _f(f)
+	{
+		;
+	}
+
+	template <typename Emit>
+	void operator()(const std::string& data, Emit& emit)
+	{
+		emit(_f(data));
+	}
+
+protected:
+	Function _f;
+};
+
+template <typename Function>
+struct filter_stage : stage< filter_stage<Function> >
+{
+	explicit filter_stage(const Function& pred)
+		: _pred(pred)
+	{
+		;
+	}
+
+	template <typename Emit>
+	void operator()(const std::string& data, Emit& emit)
+	{
+		if(_pred(data))
+		{
+			emit(data);
+		}
+	}
+
+protected:
+	Function _pred;
+};
+
+// the function type is kept, lambdas are inlined in the chain
+template <typename Function>
+map_stage<Function> map(const Function& f)
+{
+	return map_stage<Function>(f);
+}
+
+template <typename Function>
+filter_stage<Function> filter(const Function& pred)
+{
+	return filter_stage<Function>(pred);
+}
+
+}
+
+}
+
+#endif
+
@@ -0,0 +1,282 @@
+#ifndef _CU_NUMERIC_H_
+#define _CU_NUMERIC_H_
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <type_traits>
+#include "channel.h"
+#include "typed.h"
+
+namespace cu {
+
+/*
+generic typed links for numeric channels:
+
+typed_channel<std::string, double> c(sch, 10);
+c.pipeline(cat() | typed::cut<int>(1) | numeric::filter<int>([](int x) { return x > 0; })
+				 | numeric::map<int>([](int x) { return x * 0.5; }) | numeric::mean<double>());
+
+the batch_* versions reduce chunks (see batch(n)) with loops over contiguous
+arrays that the compiler vectorizes, one element is one std::vector<T>.
+*/
+namespace numeric {
+
+namespace detail {
+
+	// 4 independent accumulators: no dependency between iterations, vectorizable
+	template <typename Acc, typename T>
+	Acc sum(const T* data, size_t n)
+	{
+		Acc acc0 = Acc(), acc1 = Acc(), acc2 = Acc(), acc3 = Acc();
+		size_t i = 0;
+		for(; i + 4 <= n; i += 4)
+		{
+			acc0 += data[i];
+			acc1 += data[i + 1];
+			acc2 += data[i + 2];
+			acc3 += data[i + 3];
+		}
+		for(; i < n; ++i)
+		{
+			acc0 += data[i];
+		}
+		return (acc0 + acc1) + (acc2 + acc3);
+	}
+
+	// n > 0
+	template <typename T, typename Compare>
+	T extreme(const T* data, size_t n, Compare&& better)
+	{
+		T acc0 = data[0], acc1 = data[0], acc2 = data[0], acc3 = data[0];
+		size_t i = 0;
+		for(; i + 4 <= n; i += 4)
+		{
+			acc0 = better(data[i], acc0) ? data[i] : acc0;
+			acc1 = better(data[i + 1], acc1) ? data[i + 1] : acc1;
+			acc2 = better(data[i + 2], acc2) ? data[i + 2] : acc2;
+			acc3 = better(data[i + 3], acc3) ? data[i + 3] : acc3;
+		}
+		for(; i < n; ++i)
+		{
+			acc0 = better(data[i], acc0) ? data[i] : acc0;
+		}
+		acc0 = better(acc1, acc0) ? acc1 : acc0;
+		acc2 = better(acc3, acc2) ? acc3 : acc2;
+		return better(acc2, acc0) ? acc2 : acc0;
+	}
+
+	// emits f(accumulated) at the end of the stream, only if there was some element
+	template <typename In, typename Out, typename State, typename Update, typename Result>
+	typed_link<In, Out> fold(State init, Update update, Result result)
+	{
+		return [=](cu::pull_type< optional<In> >& source, cu::push_type< optional<Out> >& yield)
+		{
+			State state(init);
+			bool any = false;
+			for (auto& s : source)
+			{
+				if(s)
+				{
+					update(state, *s);
+					any = true;
+				}
+				else if(s.failed())
+				{
+					yield(s.template forward<Out>());
+				}
+			}
+			if(any)
+			{
+				Out value(result(state));
+				yield(value);
+			}
+		};
+	}
+}
+
+template <typename In, typename Function>
+auto map(Function f) -> typed_link<In, std::decay_t<decltype(f(std::declval<In>()))> >
+{
+	using Out = std::decay_t<decltype(f(std::declval<In>()))>;
+	return [=](cu::pull_type< optional<In> >& source, cu::push_type< optional<Out> >& yield)
+	{
+		for (auto& s : source)
+		{
+			if(s)
+			{
+				Out value(f(*s));
+				yield(value);
+			}
+			else
+			{
+				yield(s.template forward<Out>());
+			}
+		}
+	};
+}
+
+template <typename T, typename Predicate>
+typed_link<T, T> filter(Predicate pred)
+{
+	return [=](cu::pull_type< optional<T> >& source, cu::push_type< optional<T> >& yield)
+	{
+		for (auto& s : source)
+		{
+			if(!s || pred(*s))
+			{
+				yield(s);
+			}
+		}
+	};
+}
+
+// op(acc, element) -> acc, emits acc at the end of the stream (init if empty)
+template <typename T, typename Acc, typename Operation>
+typed_link<T, Acc> reduce(Acc init, Operation op)
+{
+	return [=](cu::pull_type< optional<T> >& source, cu::push_type< optional<Acc> >& yield)
+	{
+		Acc acc(init);
+		for (auto& s : source)
+		{
+			if(s)
+			{
+				acc = op(acc, *s);
+			}
+			else if(s.failed())
+			{
+				yield(s.template forward<Acc>());
+			}
+		}
+		yield(acc);
+	};
+}
+
+template <typename T>
+typed_link<T, T> sum()
+{
+	return reduce<T>(T(), [](const T& acc, const T& x) { return acc + x; });
+}
+
+template <typename T>
+typed_link<T, T> min()
+{
+	return detail::fold<T, T>(
+		std::make_pair(false, T()),
+		[](std::pair<bool, T>& state, const T& x) { if(!state.first || (x < state.second)) state = std::make_pair(true, x); },
+		[](const std::pair<bool, T>& state) { return state.second; }
+	);
+}
+
+template <typename T>
+typed_link<T, T> max()
+{
+	return detail::fold<T, T>(
+		std::make_pair(false, T()),
+		[](std::pair<bool, T>& state, const T& x) { if(!state.first || (state.second < x)) state = std::make_pair(true, x); },
+		[](const std::pair<bool, T>& state) { return state.second; }
+	);
+}
+
+template <typename T>
+typed_link<T, double> mean()
+{
+	return detail::fold<T, double>(
+		std::make_pair(0.0, size_t(0)),
+		[](std::pair<double, size_t>& state, const T& x) { state.first += x; ++state.second; },
+		[](const std::pair<double, size_t>& state) { return state.first / state.second; }
+	);
+}
+
+// groups the elements in chunks of n (the last can be smaller)
+template <typename T>
+typed_link<T, std::vector<T> > batch(size_t n = 4096)
+{
+	return [=](cu::pull_type< optional<T> >& source, cu::push_type< optional< std::vector<T> > >& yield)
+	{
+		std::vector<T> chunk;
+		chunk.reserve(n);
+		for (auto& s : source)
+		{
+			if(s)
+			{
+				chunk.emplace_back(*s);
+				if(chunk.size() >= n)
+				{
+					yield(chunk);
+					chunk.clear();
+				}
+			}
+			else if(s.failed())
+			{
+				yield(s.template forward< std::vector<T> >());
+			}
+		}
+		if(!chunk.empty())
+		{
+			yield(chunk);
+		}
+	};
+}
+
+// Acc: accumulator type (e.g. int64_t for int samples)
+template <typename T, typename Acc = T>
+typed_link<std::vector<T>, Acc> batch_sum()
+{
+	return reduce< std::vector<T> >(Acc(), [](const Acc& acc, const std::vector<T>& chunk) {
+		return acc + detail::sum<Acc>(chunk.data(), chunk.size());
+	});
+}
+
+template <typename T>
+typed_link<std::vector<T>, T> batch_min()
+{
+	return detail::fold<std::vector<T>, T>(
+		std::make_pair(false, T()),
+		[](std::pair<bool, T>& state, const std::vector<T>& chunk) {
+			if(chunk.empty())
+				return;
+			T m = detail::extreme(chunk.data(), chunk.size(), [](const T& a, const T& b) { return a < b; });
+			if(!state.first || (m < state.second))
+				state = std::make_pair(true, m);
+		},
+		[](const std::pair<bool, T>& state) { return state.second; }
+	);
+}
+
+template <typename T>
+typed_link<std::vector<T>, T> batch_max()
+{
+	return detail::fold<std::vector<T>, T>(
+		std::make_pair(false, T()),
+		[](std::pair<bool, T>& state, const std::vector<T>& chunk) {
+			if(chunk.empty())
+				return;
+			T m = detail::extreme(chunk.data(), chunk.size(), [](const T& a, const T& b) { return b < a; });
+			if(!state.first || (state.second < m))
+				state = std::make_pair(true, m);
+		},
+		[](const std::pair<bool, T>& state) { return state.second; }
+	);
+}
+
+template <typename T>
+typed_link<std::vector<T>, double> batch_mean()
+{
+	return detail::fold<std::vector<T>, double>(
+		std::make_pair(0.0, size_t(0)),
+		[](std::pair<double, size_t>& state, const std::vector<T>& chunk) {
+			state.first += detail::sum<double>(chunk.data(), chunk.size());
+			state.second += chunk.size();
+		},
+		[](const std::pair<double, size_t>& state) { return state.first / state.second; }
+	);
+}
+
+}
+
+}
+
+#endif
+
@@ -0,0 +1,501 @@
+#ifndef _CU_PARALLEL_H_
+#define _CU_PARALLEL_H_
+
+#include <map>
+#include <deque>
+#include <queue>
+#include <functional>
+#include <type_traits>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <memory>
+#include <exception>
+#include <condition_variable>
+#include "channel.h"
+
+namespace cu {
+
+namespace detail {
+
+	// n threads running one stateless link, one input element per task
+	template <typename T>
+	class stage_pool
+	{
+	public:
+		using link = typename cu::channel<T>::link;
+
+		struct result
+		{
+			uint64_t seq;
+			std::vector< optional<T> > outputs;
+			std::exception_ptr error;
+		};
+
+		explicit stage_pool(size_t n, const link& stage)
+			: _stage(stage)
+			, _stop(false)
+		{
+			for(size_t i = 0; i < std::max<size_t>(n, 1); ++i)
+			{
+				_workers.emplace_back([this]() { _work(); });
+			}
+		}
+
+		~stage_pool()
+		{
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				_stop = true;
+			}
+			_pending.notify_all();
+			for(auto& worker : _workers)
+			{
+				worker.join();
+			}
+		}
+
+		size_t size() const
+		{
+			return _workers.size();
+		}
+
+		void submit(uint64_t seq, const T& data)
+		{
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				_tasks.emplace_back(seq, data);
+			}
+			_pending.notify_one();
+		}
+
+		// blocks until any task is finished
+		result pop()
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_finished.wait(lock, [this]() { return !_results.empty(); });
+			result r = std::move(_results.front());
+			_results.pop_front();
+			return r;
+		}
+
+	protected:
+		void _work()
+		{
+			for(;;)
+			{
+				std::pair<uint64_t, T> task;
+				{
+					std::unique_lock<std::mutex> lock(_mutex);
+					_pending.wait(lock, [this]() { return _stop || !_tasks.empty(); });
+					if(_tasks.empty())
+						return;
+					task = std::move(_tasks.front());
+					_tasks.pop_front();
+				}
+				result r;
+				r.seq = task.first;
+				try
+				{
+					std::vector<link> links{_stage};
+					r.outputs = cu::detail::_pipe<T>(links, task.second);
+				}
+				catch(...)
+				{
+					r.error = std::current_exception();
+				}
+				{
+					std::lock_guard<std::mutex> lock(_mutex);
+					_results.emplace_back(std::move(r));
+				}
+				_finished.notify_one();
+			}
+		}
+
+	protected:
+		link _stage;
+		bool _stop;
+		std::mutex _mutex;
+		std::condition_variable _pending;
+		std::condition_variable _finished;
+		std::deque< std::pair<uint64_t, T> > _tasks;
+		std::deque<result> _results;
+		std::vector<std::thread> _workers;
+	};
+
+	// one invocation of a parallel link: sequence numbers and reorder buffer
+	template <typename T>
+	class stage_batch
+	{
+	public:
+		explicit stage_batch(stage_pool<T>& pool, bool ordered)
+			: _pool(pool)
+			, _ordered(ordered)
+			, _next_seq(0)
+			, _next_emit(0)
+			, _in_flight(0)
+		{
+			;
+		}
+
+		~stage_batch()
+		{
+			// unwinding (downstream finished or threw), discard what is still running
+			while(_in_flight > 0)
+			{
+				_pool.pop();
+				--_in_flight;
+			}
+		}
+
+		template <typename Yield>
+		void push(const T& data, Yield& yield)
+		{
+			_pool.submit(_next_seq++, data);
+			++_in_flight;
+			// bound the memory used by slow consumers
+			while(_in_flight >= 2 * _pool.size())
+			{
+				_collect(yield);
+			}
+		}
+
+		template <typename Yield>
+		void flush(Yield& yield)
+		{
+			while(_in_flight > 0)
+			{
+				_collect(yield);
+			}
+		}
+
+	protected:
+		template <typename Yield>
+		void _collect(Yield& yield)
+		{
+			auto r = _pool.pop();
+			--_in_flight;
+			if(r.error)
+			{
+				std::rethrow_exception(r.error);
+			}
+			if(!_ordered)
+			{
+				for(auto& e : r.outputs)
+					yield(e);
+				return;
+			}
+			_reorder.emplace(r.seq, std::move(r.outputs));
+			while(!_reorder.empty() && (_reorder.begin()->first == _next_emit))
+			{
+				for(auto& e : _reorder.begin()->second)
+					yield(e);
+				_reorder.erase(_reorder.begin());
+				++_next_emit;
+			}
+		}
+
+	protected:
+		stage_pool<T>& _pool;
+		bool _ordered;
+		uint64_t _next_seq;
+		uint64_t _next_emit;
+		size_t _in_flight;
+		std::map< uint64_t, std::vector< optional<T> > > _reorder;
+	};
+
+	template <typename T>
+	typename cu::channel<T>::link _parallel(size_t n, const typename cu::channel<T>::link& stage, bool ordered)
+	{
+		// threads live as long as the link (and its copies)
+		auto pool = std::make_shared< stage_pool<T> >(n, stage);
+		return [pool, ordered](typename cu::channel<T>::in& source, typename cu::channel<T>::out& yield)
+		{
+			stage_batch<T> batch(*pool, ordered);
+			for (auto& s : source)
+			{
+				if(s)
+				{
+					batch.push(*s, yield);
+				}
+				else
+				{
+					batch.flush(yield);
+					yield(s);
+				}
+			}
+			batch.flush(yield);
+		};
+	}
+
+	// one sub-stream of a partition: fed by the router, consumed by the stage in its own thread
+	template <typename T>
+	class partition_worker
+	{
+	public:
+		using link = typename cu::channel<T>::link;
+
+		explicit partition_worker(const link& stage, size_t capacity = 1024)
+			: _capacity(capacity)
+			, _closed(false)
+			, _stopped(false)
+		{
+			_thread = std::thread([this, stage]() { _work(stage); });
+		}
+
+		~partition_worker()
+		{
+			if(_thread.joinable())
+			{
+				close();
+				_thread.join();
+			}
+		}
+
+		// blocks while the queue is full
+		void push(const T& data)
+		{
+			{
+				std::unique_lock<std::mutex> lock(_mutex);
+				_not_full.wait(lock, [this]() { return _stopped || (_queue.size() < _capacity); });
+				if(_stopped)
+					return;
+				_queue.emplace_back(data);
+			}
+			_not_empty.notify_one();
+		}
+
+		void close()
+		{
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				_closed = true;
+			}
+			_not_empty.notify_one();
+		}
+
+		// end of the sub-stream: waits the stage and returns its outputs
+		std::vector<T> finish()
+		{
+			close();
+			_thread.join();
+			if(_error)
+			{
+				std::rethrow_exception(_error);
+			}
+			return std::move(_outputs);
+		}
+
+	protected:
+		bool _pop(T& data)
+		{
+			{
+				std::unique_lock<std::mutex> lock(_mutex);
+				_not_empty.wait(lock, [this]() { return _closed || !_queue.empty(); });
+				if(_queue.empty())
+					return false;
+				data = std::move(_queue.front());
+				_queue.pop_front();
+			}
+			_not_full.notify_one();
+			return true;
+		}
+
+		void _work(const link& stage)
+		{
+			try
+			{
+				typename cu::channel<T>::in source(
+					[this](typename cu::channel<T>::out& yield)
+					{
+						T data;
+						while(_pop(data))
+						{
+							yield(data);
+						}
+					}
+				);
+				typename cu::channel<T>::out sink(
+					[this](typename cu::channel<T>::in& results)
+					{
+						for (auto& r : results)
+						{
+							if(r)
+							{
+								_outputs.emplace_back(*r);
+							}
+							else if(r.failed())
+							{
+								// the gather only moves values, the error stops the partition
+								throw std::runtime_error(r.get_error().message);
+							}
+						}
+					}
+				);
+				stage(source, sink);
+			}
+			catch(...)
+			{
+				_error = std::current_exception();
+			}
+			// the stage can finish before its input (head, error ...), don't leave the router blocked in push
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				_stopped = true;
+			}
+			_not_full.notify_all();
+		}
+
+	protected:
+		size_t _capacity;
+		bool _closed;
+		bool _stopped;
+		std::mutex _mutex;
+		std::condition_variable _not_empty;
+		std::condition_variable _not_full;
+		std::deque<T> _queue;
+		std::vector<T> _outputs;
+		std::exception_ptr _error;
+		std::thread _thread;
+	};
+
+	template <typename T, typename Yield>
+	void _gather_concat(std::vector< std::vector<T> >& partials, Yield& yield)
+	{
+		for(auto& partial : partials)
+		{
+			for(auto& e : partial)
+				yield(e);
+		}
+	}
+
+	// k-way merge, each partial is already sorted by cmp
+	template <typename T, typename Compare, typename Yield>
+	void _gather_sorted(std::vector< std::vector<T> >& partials, const Compare& cmp, Yield& yield)
+	{
+		using cursor = std::pair<size_t, size_t>;  // (partition, position)
+		auto later = [&](const cursor& a, const cursor& b)
+		{
+			const T& x = partials[a.first][a.second];
+			const T& y = partials[b.first][b.second];
+			return cmp(y, x) || (!cmp(x, y) && (b.first < a.first));
+		};
+		std::priority_queue<cursor, std::vector<cursor>, decltype(later)> heads(later);
+		for(size_t i = 0; i < partials.size(); ++i)
+		{
+			if(!partials[i].empty())
+				heads.emplace(i, 0);
+		}
+		while(!heads.empty())
+		{
+			cursor c = heads.top();
+			heads.pop();
+			yield(partials[c.first][c.second]);
+			if(++c.second < partials[c.first].size())
+				heads.push(c);
+		}
+	}
+
+	template <typename T, typename KeyFn, typename Gather>
+	typename cu::channel<T>::link _partition(size_t n, KeyFn key_fn, const typename cu::channel<T>::link& stage, Gather gather)
+	{
+		n = std::max<size_t>(n, 1);
+		return [=](typename cu::channel<T>::in& source, typename cu::channel<T>::out& yield)
+		{
+			std::vector< std::unique_ptr< partition_worker<T> > > workers;
+			auto finish = [&]()
+			{
+				std::vector< std::vector<T> > partials;
+				for(auto& worker : workers)
+				{
+					partials.emplace_back(worker->finish());
+				}
+				workers.clear();
+				gather(partials, yield);
+			};
+			for (auto& s : source)
+			{
+				if(s)
+				{
+					if(workers.empty())
+					{
+						for(size_t i = 0; i < n; ++i)
+						{
+							workers.emplace_back(std::make_unique< partition_worker<T> >(stage));
+						}
+					}
+					using key_type = std::decay_t<decltype(key_fn(*s))>;
+					workers[std::hash<key_type>()(key_fn(*s)) % n]->push(*s);
+				}
+				else
+				{
+					// the close mark ends the partitioned group
+					if(!workers.empty())
+					{
+						finish();
+					}
+					yield(s);
+				}
+			}
+			if(!workers.empty())
+			{
+				finish();
+			}
+		};
+	}
+}
+
+
+/*
+runs a stateless stage on n threads, each element of the stream is a task.
+outputs are reassembled in input order using a reorder buffer.
+usage: c.pipeline(find(), cu::parallel(4, cat()), grep("error"))
+*/
+template <typename T = std::string>
+typename cu::channel<T>::link parallel(size_t n, const typename cu::channel<T>::link& stage)
+{
+	return cu::detail::_parallel<T>(n, stage, true);
+}
+
+// same as parallel but outputs are yielded as soon as they are ready
+template <typename T = std::string>
+typename cu::channel<T>::link parallel_unordered(size_t n, const typename cu::channel<T>::link& stage)
+{
+	return cu::detail::_parallel<T>(n, stage, false);
+}
+
+/*
+hash partitioning for stateful stages (uniq, sort, count ...): each element goes to
+the partition hash(key_fn(element)) % n, every partition runs its own copy of stage
+in its own thread. the same key is always in the same partition, so per key
+aggregations don't need a global lock. the outputs of the partitions are gathered
+(concatenated in partition order) at the end of the stream.
+usage: c.pipeline(cat(), cu::partition(4, first_word, uniq()), sort())
+*/
+template <typename T = std::string, typename KeyFn>
+typename cu::channel<T>::link partition(size_t n, KeyFn key_fn, const typename cu::channel<T>::link& stage)
+{
+	return cu::detail::_partition<T>(n, key_fn, stage,
+		[](std::vector< std::vector<T> >& partials, typename cu::channel<T>::out& yield)
+		{
+			cu::detail::_gather_concat(partials, yield);
+		}
+	);
+}
+
+// same as partition, when the stage yields sorted outputs they are merged in order
+template <typename T = std::string, typename KeyFn, typename Compare = std::less<T> >
+typename cu::channel<T>::link partition_sorted(size_t n, KeyFn key_fn, const typename cu::channel<T>::link& stage, Compare cmp = Compare())
+{
+	return cu::detail::_partition<T>(n, key_fn, stage,
+		[cmp](std::vector< std::vector<T> >& partials, typename cu::channel<T>::out& yield)
+		{
+			cu::detail::_gather_sorted(partials, cmp, yield);
+		}
+	);
+}
+
+}
+
+#endif
+
@@ -11,7 +11,6 @@ class parallel_scheduler : public scheduler {
 public:
 
 	explicit parallel_scheduler()
-		: _ite( _running.begin() )
 	{
 		;
 	}
@@ -28,40 +27,39 @@ public:
 
 	bool run() override final
 	{
-		_ite = _running.begin();
-		while (_ite != _running.end())
+		_drain_remote();
+		_run_timers();
+		// by index: a running cpproutine can spawn or wake up others (grows _running)
+		size_t i = 0;
+		while (i < _running.size())
 		{
-			auto& c = *_ite;
-			if(c->ready())
+			if(_running[i]->ready())
 			{
-				_active = c.get();
+				_active = _running[i].get();
 				{
 					_move_to_blocked = false;
 					_last_id = -1;
-					c->run();
+					_active->run();
 					if (_move_to_blocked)
 					{
 						auto& blocked = _blocked[_last_id];
-						blocked.emplace_back(std::move(c));
-						_ite = _running.erase(_ite);
+						blocked.emplace_back(std::move(_running[i]));
+						_running.erase(_running.begin() + i);
 					}
 					else
 					{
-						++_ite;
+						++i;
 					}
 				}
 				_active = nullptr;
 			}
 			else
 			{
-				_ite = _running.erase(_ite);
+				_running.erase(_running.begin() + i);
 			}
 		}
 		return ready();
 	}
-
-protected:
-	std::vector<std::unique_ptr<scheduler_basic> >::iterator _ite;
 };
 
 }
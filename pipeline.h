@@ -0,0 +1,112 @@
+#ifndef _CU_PIPELINE_H_
+#define _CU_PIPELINE_H_
+
+#include <vector>
+#include <functional>
+#include "channel.h"
+
+namespace cu {
+
+/*
+the links of a channel without the channel: each call runs the links inline and
+the results go to the sink as they are yielded. no semaphores, no buffer and no
+scheduler, for batch jobs and plain code that never spawns consumers:
+
+cu::pipeline<std::string> p(cat(), grep("error"), cut(0));
+p.sink([](const std::string& line) { std::cout << line << std::endl; });
+p("app.log");
+
+same as channel, each call is one stream: count(), sort() ... emit at the end of the call.
+*/
+template <typename T>
+class pipeline
+{
+public:
+	using link = cu::link< optional<T> >;
+
+	template <typename ... Functions>
+	explicit pipeline(Functions&& ... fs)
+		: _links{link(std::forward<Functions>(fs))...}
+	{
+		;
+	}
+
+	void sink(std::function<void(const T&)> f)
+	{
+		_sink = std::move(f);
+	}
+
+	// raise (default) throws in the caller, skip discards them
+	void set_error_policy(error_policy policy)
+	{
+		_error_policy = policy;
+	}
+
+	void on_error(std::function<void(const element_error&)> handler)
+	{
+		_error_handler = std::move(handler);
+	}
+
+	template <typename R>
+	void operator()(const R& data)
+	{
+		cu::detail::_pipe_into<T>(_links, T(data), [this](const optional<T>& e)
+		{
+			if(e)
+			{
+				if(_sink)
+				{
+					_sink(*e);
+				}
+			}
+			else
+			{
+				_on_error(e.get_error());
+			}
+		});
+	}
+
+	// without sink: the results of one call
+	template <typename R>
+	std::vector<T> collect(const R& data)
+	{
+		std::vector<T> results;
+		auto previous = std::move(_sink);
+		_sink = [&results](const T& e) { results.emplace_back(e); };
+		try
+		{
+			operator()(data);
+		}
+		catch(...)
+		{
+			_sink = std::move(previous);
+			throw;
+		}
+		_sink = std::move(previous);
+		return results;
+	}
+
+protected:
+	void _on_error(const element_error& error)
+	{
+		if(_error_handler)
+		{
+			_error_handler(error);
+		}
+		else if(_error_policy == error_policy::raise)
+		{
+			throw std::runtime_error(error.message);
+		}
+	}
+
+protected:
+	std::vector<link> _links;
+	std::function<void(const T&)> _sink;
+	error_policy _error_policy = error_policy::raise;
+	std::function<void(const element_error&)> _error_handler;
+};
+
+}
+
+#endif
+
@@ -0,0 +1,132 @@
+#ifndef _CU_READER_H_
+#define _CU_READER_H_
+
+#include <string>
+#include <memory>
+#include <cstdio>
+#include <cstring>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace cu {
+
+/*
+splits a file in lines without a heap allocation per line, for multi-GB logs:
+
+cu::read_lines("app.log", [](const char* line, size_t length, const std::shared_ptr<const void>& owner) { ... });
+
+line is not '\0' terminated and has not the '\n'. the bytes are valid while owner
+is alive (keep a copy of owner to keep the line). regular files are mapped (mmap),
+the rest (pipes, /proc, WIN32 ...) is read in chunks of chunk_bytes, a line
+between two chunks is moved to the next one, never cut.
+*/
+namespace detail {
+
+	// f for each complete line in [begin, end), returns the start of the incomplete tail
+	template <typename Function>
+	const char* _split_lines(const char* begin, const char* end, const std::shared_ptr<const void>& owner, Function& f)
+	{
+		while(begin < end)
+		{
+			const char* nl = static_cast<const char*>(memchr(begin, '\n', end - begin));
+			if(!nl)
+			{
+				break;
+			}
+			f(begin, size_t(nl - begin), owner);
+			begin = nl + 1;
+		}
+		return begin;
+	}
+
+	// same, the incomplete tail is the last line (end of the file)
+	template <typename Function>
+	void _split_all(const char* begin, const char* end, const std::shared_ptr<const void>& owner, Function& f)
+	{
+		begin = _split_lines(begin, end, owner, f);
+		if(begin < end)
+		{
+			// last line without '\n'
+			f(begin, size_t(end - begin), owner);
+		}
+	}
+
+#ifndef WIN32
+	// false if the file can't be mapped (empty, not regular ...), then it is read
+	template <typename Function>
+	bool _read_mapped(int fd, Function& f)
+	{
+		struct stat info;
+		if((fstat(fd, &info) != 0) || !S_ISREG(info.st_mode) || (info.st_size == 0))
+		{
+			return false;
+		}
+		size_t size = size_t(info.st_size);
+		void* addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if(addr == MAP_FAILED)
+		{
+			return false;
+		}
+		madvise(addr, size, MADV_SEQUENTIAL);
+		std::shared_ptr<const void> owner(addr, [size](const void* p) { munmap(const_cast<void*>(p), size); });
+		const char* begin = static_cast<const char*>(addr);
+		_split_all(begin, begin + size, owner, f);
+		return true;
+	}
+#endif
+
+	template <typename Function>
+	void _read_buffered(FILE* input, Function& f, size_t chunk_bytes)
+	{
+#ifndef WIN32
+		posix_fadvise(fileno(input), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+		std::string tail;
+		for(;;)
+		{
+			// a new buffer per chunk: the lines of the previous one can be still alive
+			auto buffer = std::make_shared<std::string>(std::move(tail));
+			size_t carried = buffer->size();
+			buffer->resize(carried + chunk_bytes);
+			size_t n = fread(&(*buffer)[carried], 1, chunk_bytes, input);
+			buffer->resize(carried + n);
+			std::shared_ptr<const void> owner(buffer);
+			const char* end = buffer->data() + buffer->size();
+			if(n < chunk_bytes)
+			{
+				_split_all(buffer->data(), end, owner, f);
+				return;
+			}
+			tail.assign(_split_lines(buffer->data(), end, owner, f), end);
+		}
+	}
+}
+
+// false if the file can't be opened
+template <typename Function>
+bool read_lines(const std::string& filename, Function&& f, size_t chunk_bytes = 1 << 20, bool mapped = true)
+{
+	std::unique_ptr<FILE, int(*)(FILE*)> input(fopen(filename.c_str(), "rb"), fclose);
+	if(!input)
+	{
+		return false;
+	}
+#ifndef WIN32
+	if(mapped && detail::_read_mapped(fileno(input.get()), f))
+	{
+		return true;
+	}
+#endif
+	detail::_read_buffered(input.get(), f, chunk_bytes);
+	return true;
+}
+
+}
+
+#endif
+
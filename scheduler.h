@@ -2,6 +2,13 @@
 #define _CU_SCHEDULER_H_
 
 #include <map>
+#include <queue>
+#include <vector>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <limits>
 #include <teelogging/teelogging.h>
 #include "cpproutine.h"
 #include <asyncply/run.h>
@@ -60,6 +67,9 @@ static void await(cu::yield_type& yield, TOKEN token)
 	}
 }
 
+// see scheduler::call_at
+using timer_id = uint64_t;
+
 // implementar ejecutar corutina "atexit" al salir
 class scheduler : public scheduler_basic
 {
@@ -92,8 +102,13 @@ public:
 
 	void run_until_complete()
 	{
-		while(ready())
+		while(ready() || (_remote_waiters > 0) || _waiting_timers())
 		{
+			if(!ready())
+			{
+				// all cpproutines are waiting for other threads or timers
+				_wait_remote();
+			}
 			run();
 		}
 		
@@ -115,7 +130,8 @@ public:
 
 	std::string get_name() const override final
 	{
-		return _active->get_name();
+		// remote wakeups are resumed from outside any cpproutine
+		return _active ? _active->get_name() : "scheduler";
 	}
 
 	pid_type getpid() const override final
@@ -131,7 +147,12 @@ public:
 
 	bool notify_one(int id)
 	{
-		auto& blocked = _blocked[id];
+		auto it = _blocked.find(id);
+		if(it == _blocked.end())
+		{
+			return false;
+		}
+		auto& blocked = it->second;
 		if(blocked.size() > 0)
 		{
 			LOGV("<%s> begin resuming", get_name().c_str());
@@ -148,9 +169,32 @@ public:
 		return  false;
 	}
 
+	// like wait(id) but the wakeup will come from another thread (notify_remote)
+	void wait_remote(int id)
+	{
+		++_remote_waiters;
+		wait(id);
+	}
+
+	// thread safe, the cpproutine is resumed by the scheduler thread
+	void notify_remote(int id)
+	{
+		{
+			std::lock_guard<std::mutex> lock(_remote_mutex);
+			_remote_pending.emplace_back(id);
+			_remote_signaled = true;
+		}
+		_remote_cv.notify_one();
+	}
+
 	bool notify_all(int id)
 	{
-		auto& blocked = _blocked[id];
+		auto it = _blocked.find(id);
+		if(it == _blocked.end())
+		{
+			return false;
+		}
+		auto& blocked = it->second;
 		bool notified_any = false;
 		while(blocked.size() > 0)
 		{
@@ -158,16 +202,139 @@ public:
 			LOGV("%s se desbloquea porque ha sido despertado por la señal %d", (*blocked.begin())->get_name().c_str(), id);
 			_running.emplace(_running.end(), std::move(*blocked.begin()));
 			blocked.erase(blocked.begin());
-			if(blocked.size() == 0)
-			{
-				_blocked.erase(id);
-			}
 			notified_any = true;
 			LOGV("<%s> end resuming", get_name().c_str());
 		}
+		_blocked.erase(it);
 		return notified_any;
 	}
 
+	/*
+	timers: the callback runs in the scheduler thread between cpproutines,
+	it can't yield (use the versions without yield: semaphore::notify(), ...)
+	returns an id for cancel
+	*/
+	timer_id call_at(fes::marktime due, std::function<void()> callback)
+	{
+		timer_id id = _timer_counter++;
+		_timers.push(timer{due, _timer_seq++, id});
+		_timer_callbacks.emplace(id, std::move(callback));
+		return id;
+	}
+
+	timer_id call_later(fes::deltatime delay, std::function<void()> callback)
+	{
+		return call_at(fes::high_resolution_clock() + delay, std::move(callback));
+	}
+
+	void cancel(timer_id id)
+	{
+		_timer_callbacks.erase(id);
+	}
+
+	// suspends the cpproutine until delay, it is not resumed meanwhile
+	void sleep_for(cu::yield_type& yield, fes::deltatime delay)
+	{
+		int id = _next_sleep_id();
+		call_later(delay, [this, id]() { notify_one(id); });
+		wait(id);
+		yield( cu::control_type{} );
+	}
+
+protected:
+	struct timer
+	{
+		fes::marktime due;
+		uint64_t seq;
+		timer_id id;
+	};
+
+	struct timer_later
+	{
+		bool operator()(const timer& a, const timer& b) const
+		{
+			return (a.due > b.due) || ((a.due == b.due) && (a.seq > b.seq));
+		}
+	};
+
+	void _run_timers()
+	{
+		if(_timers.empty())
+		{
+			return;
+		}
+		auto now = fes::high_resolution_clock();
+		while(!_timers.empty() && (_timers.top().due <= now))
+		{
+			timer_id id = _timers.top().id;
+			_timers.pop();
+			auto it = _timer_callbacks.find(id);
+			if(it == _timer_callbacks.end())
+			{
+				// cancelled
+				continue;
+			}
+			auto callback = std::move(it->second);
+			_timer_callbacks.erase(it);
+			callback();
+		}
+	}
+
+	// wait ids of sleep_for: negative (semaphores use cu::last_id >= 0), wrap before overflow
+	int _next_sleep_id()
+	{
+		do
+		{
+			_sleep_ids = (_sleep_ids == std::numeric_limits<int>::min()) ? -1 : _sleep_ids - 1;
+		} while(_blocked.count(_sleep_ids) > 0);
+		return _sleep_ids;
+	}
+
+	// somebody is blocked and a timer can wake it up
+	bool _waiting_timers() const
+	{
+		return !_blocked.empty() && !_timer_callbacks.empty();
+	}
+
+	void _drain_remote()
+	{
+		if(!_remote_signaled.exchange(false))
+		{
+			return;
+		}
+		std::vector<int> pending;
+		{
+			std::lock_guard<std::mutex> lock(_remote_mutex);
+			pending.swap(_remote_pending);
+		}
+		for(auto id : pending)
+		{
+			if(notify_one(id))
+			{
+				--_remote_waiters;
+			}
+		}
+	}
+
+	void _wait_remote()
+	{
+		// cancelled timers are discarded here, don't sleep until them
+		while(!_timers.empty() && (_timer_callbacks.count(_timers.top().id) == 0))
+		{
+			_timers.pop();
+		}
+		std::unique_lock<std::mutex> lock(_remote_mutex);
+		if(_timers.empty())
+		{
+			_remote_cv.wait(lock, [this]() { return !_remote_pending.empty(); });
+		}
+		else
+		{
+			auto remaining = _timers.top().due - fes::high_resolution_clock();
+			_remote_cv.wait_for(lock, remaining, [this]() { return !_remote_pending.empty(); });
+		}
+	}
+
 protected:
 	scheduler_basic* _active;
 	// normal running
@@ -177,6 +344,18 @@ protected:
 	pid_type _pid_counter;
 	bool _move_to_blocked;
 	int _last_id;
+	// cpproutines waiting for other threads
+	int _remote_waiters = 0;
+	std::atomic<bool> _remote_signaled{false};
+	std::mutex _remote_mutex;
+	std::condition_variable _remote_cv;
+	std::vector<int> _remote_pending;
+	// timers
+	std::priority_queue<timer, std::vector<timer>, timer_later> _timers;
+	std::map<timer_id, std::function<void()> > _timer_callbacks;
+	timer_id _timer_counter = 0;
+	uint64_t _timer_seq = 0;
+	int _sleep_ids = 0;
 };
 
 }
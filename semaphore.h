@@ -68,6 +68,18 @@ public:
 		}
 	}
 
+	//! takes one only if it doesn't block
+	bool try_wait()
+	{
+		if(_count <= 0)
+		{
+			return false;
+		}
+		--_count;
+		LOGV("<%d> decrease semaphore from %d to %d", _id, _count+1, _count);
+		return true;
+	}
+
 	inline bool empty() const
 	{
 		return (_count <= 0);
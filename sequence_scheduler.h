@@ -21,6 +21,8 @@ public:
 
 	bool run() override final
 	{
+		_drain_remote();
+		_run_timers();
 		auto i = _running.begin();
 		while (i != _running.end())
 		{
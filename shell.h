@@ -8,6 +8,8 @@
 #include <sstream>
 #include <exception>
 #include <vector>
+#include <memory>
+#include <functional>
 #include <algorithm>
 #include <locale>
 #include <boost/tokenizer.hpp>
@@ -20,6 +22,7 @@
 ////
 #include <cstdio>
 #include <cstdlib>
+#include <cerrno>
 #include <fcntl.h>
 
 #ifdef LINUX
@@ -56,6 +59,7 @@
 ////
 
 #include "channel.h"
+#include "reader.h"
 
 namespace cu {
 
@@ -139,11 +143,11 @@ ch_str::link cat(const std::string& filename)
 {
 	return [=](ch_str::in&, ch_str::out& yield)
 	{
-		std::ifstream input(filename);
-		for (std::string line; std::getline(input, line);)
-		{
+		std::string line;
+		read_lines(filename, [&](const char* data, size_t length, const std::shared_ptr<const void>&) {
+			line.assign(data, length);
 			yield(line);
-		}
+		});
 	};
 }
 
@@ -513,7 +517,8 @@ ch_str::link assert_string(const std::string& matching)
 					std::stringstream ss;
 					ss << "error in string: " << *s << ", expected value: " << matching << std::endl;
 					LOGE("%s", ss.str().c_str());
-					throw std::runtime_error(ss.str());
+					yield(optional<std::string>::fail(1, ss.str()));
+					continue;
 				}
 			}
 			yield(s);
@@ -535,7 +540,9 @@ ch_str::link assert_string(const std::vector<std::string>& matches)
 					std::stringstream ss;
 					ss << "error in string: " << *s << ", expected value: " << matches[i] << std::endl;
 					LOGE("%s", ss.str().c_str());
-					throw std::runtime_error(ss.str());
+					yield(optional<std::string>::fail(1, ss.str()));
+					++i;
+					continue;
 				}
 				++i;
 			}
@@ -544,8 +551,7 @@ ch_str::link assert_string(const std::vector<std::string>& matches)
 	};
 }
 
-// TODO: implment, max, min and reduce
-// aplicar funcion a cada elemento que pasa, map(x -> 10 * x)
+// map, filter, reduce, min, max, sum and mean over typed channels: see numeric.h
 // implementar repeat(3)
 
 ch_str::link count()
@@ -559,11 +565,65 @@ ch_str::link count()
 			{
 				++total;
 			}
+			else if(s.failed())
+			{
+				yield(s);
+			}
 		}
 		yield(std::to_string(total));
 	};
 }
 
+// stops after n elements, the upstream links are not pulled anymore
+ch_str::link head(size_t n = 10)
+{
+	return [=](ch_str::in& source, ch_str::out& yield)
+	{
+		if(n == 0)
+		{
+			return;
+		}
+		size_t i = 0;
+		for (auto& s : source)
+		{
+			yield(s);
+			if(s && (++i >= n))
+			{
+				// return without advancing source
+				return;
+			}
+		}
+	};
+}
+
+ch_str::link first()
+{
+	return head(1);
+}
+
+// stops in the first element that not matches pred
+ch_str::link take_while(const std::function<bool(const std::string&)>& pred)
+{
+	return [=](ch_str::in& source, ch_str::out& yield)
+	{
+		for (auto& s : source)
+		{
+			if(s)
+			{
+				if(!pred(*s))
+				{
+					return;
+				}
+				yield(s);
+			}
+			else
+			{
+				yield(s);
+			}
+		}
+	};
+}
+
 ch_str::link clear()
 {
 	return [=](ch_str::in& source, ch_str::out& yield)
@@ -627,7 +687,7 @@ ch_str::link assert_count(size_t expected)
 			std::stringstream ss;
 			ss << "<assert_count> error count: " << total << ", but expected value: " << expected << std::endl;
 			LOGE("%s", ss.str().c_str());
-			throw std::runtime_error(ss.str());
+			yield(optional<std::string>::fail(1, ss.str()));
 		}
 	};
 }
@@ -906,24 +966,24 @@ ch_str::link toupper()
 
 ch_str::link run(const std::string& ch_str)
 {
-	char buff[BUFSIZ];
-	return [ch_str, &buff](ch_str::in&, ch_str::out& yield)
+	return [ch_str](ch_str::in&, ch_str::out& yield)
 	{
 		file_redirect silence_err(stderr, stdout);
 		
-		FILE *in;
-		if(!(in = popen(ch_str.c_str(), "r")))
+		char buff[BUFSIZ];
+		// pclose also when a downstream link (head, ...) stops the pipeline
+		std::unique_ptr<FILE, int(*)(FILE*)> in(popen(ch_str.c_str(), "r"), pclose);
+		if(!in)
 		{
 			std::stringstream ss;
 			ss << "Error executing command: " << ch_str;
-			throw std::runtime_error(ss.str());
-			// TODO: Yield exception in optional
+			yield(optional<std::string>::fail(errno, ss.str()));
+			return;
 		}
-		while(fgets(buff, BUFSIZ, in) != 0)
+		while(fgets(buff, BUFSIZ, in.get()) != 0)
 		{
 			yield(std::string(buff));
 		}
-		pclose(in);
 	};
 }
 
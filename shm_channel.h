@@ -0,0 +1,468 @@
+#ifndef _CU_SHM_CHANNEL_H_
+#define _CU_SHM_CHANNEL_H_
+
+#include <atomic>
+#include <string>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <climits>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef LINUX
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+#include <coroutine/coroutine.h>
+#include "channel.h"
+#include "spill.h"
+#include "thread_channel.h"
+
+namespace cu {
+
+namespace detail {
+
+	inline void futex_wait(std::atomic<uint32_t>& word, uint32_t expected)
+	{
+#ifdef LINUX
+		// shared between processes, no FUTEX_PRIVATE_FLAG
+		syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT, expected, nullptr, nullptr, 0);
+#else
+		while(word.load() == expected)
+		{
+			std::this_thread::sleep_for(std::chrono::microseconds(50));
+		}
+#endif
+	}
+
+	inline void futex_wake(std::atomic<uint32_t>& word)
+	{
+		word.fetch_add(1);
+#ifdef LINUX
+		syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+#endif
+	}
+
+	// sleeps in the futex for one cpproutine at a time and wakes it up with notify_remote
+	class futex_watcher
+	{
+	public:
+		explicit futex_watcher(cu::parallel_scheduler& sche)
+			: _waiters(sche)
+			, _word(nullptr)
+			, _expected(0)
+			, _done(false)
+			, _stop(false)
+		{
+			;
+		}
+
+		~futex_watcher()
+		{
+			if(!_thread.joinable())
+			{
+				return;
+			}
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				_stop = true;
+				if(_word)
+				{
+					// the other side sees a spurious wakeup and rechecks
+					futex_wake(*_word);
+				}
+			}
+			_pending.notify_one();
+			_thread.join();
+		}
+
+		futex_watcher(const futex_watcher&) = delete;
+		futex_watcher& operator=(const futex_watcher&) = delete;
+
+		void wait(cu::yield_type& yield, std::atomic<uint32_t>& word, uint32_t expected)
+		{
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				_word = &word;
+				_expected = expected;
+				_done = false;
+				if(!_thread.joinable())
+				{
+					_thread = std::thread([this]() { _loop(); });
+				}
+			}
+			_pending.notify_one();
+			while(!_waiters.wait(yield, [this]() { return _done.load(); }))
+			{
+				;
+			}
+		}
+
+	protected:
+		void _loop()
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			for(;;)
+			{
+				_pending.wait(lock, [this]() { return _stop || _word; });
+				if(_stop)
+				{
+					return;
+				}
+				std::atomic<uint32_t>* word = _word;
+				uint32_t expected = _expected;
+				lock.unlock();
+				futex_wait(*word, expected);
+				lock.lock();
+				_word = nullptr;
+				_done = true;
+				_waiters.notify();
+			}
+		}
+
+	protected:
+		coroutine_waiters _waiters;
+		std::thread _thread;
+		std::mutex _mutex;
+		std::condition_variable _pending;
+		std::atomic<uint32_t>* _word;
+		uint32_t _expected;
+		std::atomic<bool> _done;
+		bool _stop;
+	};
+
+	// lives at the beginning of the shared memory, followed by the ring
+	struct shm_header
+	{
+		std::atomic<uint32_t> magic;
+		uint32_t capacity;
+		std::atomic<uint64_t> head;
+		std::atomic<uint64_t> tail;
+		std::atomic<uint32_t> data_seq;
+		std::atomic<uint32_t> space_seq;
+		std::atomic<uint32_t> readers_waiting;
+		std::atomic<uint32_t> writers_waiting;
+	};
+
+	static const uint32_t shm_magic = 0x63755348;
+}
+
+enum class shm_mode
+{
+	create,
+	open
+};
+
+/*
+channel between processes of the same host over a ring mapped in /dev/shm.
+one producer and one consumer (processes or threads). records are
+[uint32 size][uint8 valid][payload] with payload written by cu::serializer<T>.
+the fast path is only atomics, futex syscalls are done only when a side must sleep.
+cpproutines use the versions with yield (the channel is built with the scheduler):
+a watcher thread sleeps in the futex for them and wakes them up with notify_remote,
+the scheduler goes on with the other cpproutines.
+*/
+template <typename T, typename Serializer = cu::serializer<T> >
+class shm_channel
+{
+public:
+	// capacity of the ring in bytes, only used in create mode
+	explicit shm_channel(const std::string& name, shm_mode mode = shm_mode::open, size_t capacity = 1 << 20)
+		: _name(name)
+		, _owner(mode == shm_mode::create)
+		, _header(nullptr)
+		, _ring(nullptr)
+		, _size(0)
+	{
+		_map(capacity);
+	}
+
+	// needed by the versions with yield
+	explicit shm_channel(cu::parallel_scheduler& sche, const std::string& name, shm_mode mode = shm_mode::open, size_t capacity = 1 << 20)
+		: shm_channel(name, mode, capacity)
+	{
+		_readers.reset(new detail::futex_watcher(sche));
+		_writers.reset(new detail::futex_watcher(sche));
+	}
+
+	~shm_channel()
+	{
+		// the watchers can be sleeping in the mapped memory
+		_readers.reset();
+		_writers.reset();
+		munmap(_header, _size);
+		if(_owner)
+		{
+			shm_unlink(_name.c_str());
+		}
+	}
+
+	shm_channel(const shm_channel&) = delete;
+	shm_channel& operator=(const shm_channel&) = delete;
+
+	// blocks the thread while the ring is full
+	void send(const T& data)
+	{
+		_encode(optional<T>(data));
+		while(!_try_write())
+		{
+			_wait(_header->space_seq, _header->writers_waiting, [this]() { return _fits(); });
+		}
+	}
+
+	void close()
+	{
+		_encode(optional<T>(true));
+		while(!_try_write())
+		{
+			_wait(_header->space_seq, _header->writers_waiting, [this]() { return _fits(); });
+		}
+	}
+
+	// blocks the thread while the ring is empty
+	optional<T> get()
+	{
+		optional<T> data(true);
+		while(!_try_read(data))
+		{
+			_wait(_header->data_seq, _header->readers_waiting, [this]() { return !_empty(); });
+		}
+		return data;
+	}
+
+	template <typename R>
+	void operator()(cu::yield_type& yield, const R& data)
+	{
+		T element(data);
+		_encode(optional<T>(element));
+		while(!_try_write())
+		{
+			_wait(yield, _writers.get(), _header->space_seq, _header->writers_waiting, [this]() { return _fits(); });
+		}
+	}
+
+	void close(cu::yield_type& yield)
+	{
+		_encode(optional<T>(true));
+		while(!_try_write())
+		{
+			_wait(yield, _writers.get(), _header->space_seq, _header->writers_waiting, [this]() { return _fits(); });
+		}
+	}
+
+	optional<T> get(cu::yield_type& yield)
+	{
+		optional<T> data(true);
+		while(!_try_read(data))
+		{
+			_wait(yield, _readers.get(), _header->data_seq, _header->readers_waiting, [this]() { return !_empty(); });
+		}
+		return data;
+	}
+
+protected:
+	void _map(size_t capacity)
+	{
+		int fd = shm_open(_name.c_str(), _owner ? (O_CREAT | O_TRUNC | O_RDWR) : O_RDWR, 0600);
+		if(fd == -1)
+		{
+			throw std::runtime_error("shm_channel: can't open " + _name);
+		}
+		if(_owner)
+		{
+			_size = sizeof(detail::shm_header) + capacity;
+			if(ftruncate(fd, off_t(_size)) == -1)
+			{
+				::close(fd);
+				throw std::runtime_error("shm_channel: can't resize " + _name);
+			}
+		}
+		else
+		{
+			// the creator can be between shm_open and ftruncate
+			struct stat st;
+			do
+			{
+				if(fstat(fd, &st) == -1)
+				{
+					::close(fd);
+					throw std::runtime_error("shm_channel: can't stat " + _name);
+				}
+				if(st.st_size == 0)
+				{
+					std::this_thread::yield();
+				}
+			} while(st.st_size == 0);
+			_size = size_t(st.st_size);
+		}
+		void* mem = mmap(nullptr, _size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		::close(fd);
+		if(mem == MAP_FAILED)
+		{
+			throw std::runtime_error("shm_channel: can't map " + _name);
+		}
+		_header = static_cast<detail::shm_header*>(mem);
+		_ring = static_cast<char*>(mem) + sizeof(detail::shm_header);
+		if(_owner)
+		{
+			_header->capacity = uint32_t(capacity);
+			_header->head = 0;
+			_header->tail = 0;
+			_header->data_seq = 0;
+			_header->space_seq = 0;
+			_header->readers_waiting = 0;
+			_header->writers_waiting = 0;
+			_header->magic.store(detail::shm_magic);
+		}
+		else
+		{
+			while(_header->magic.load() != detail::shm_magic)
+			{
+				std::this_thread::yield();
+			}
+		}
+	}
+
+	void _encode(const optional<T>& data)
+	{
+		_payload.clear();
+		if(data)
+		{
+			Serializer::write(_payload, *data);
+		}
+		uint32_t size = uint32_t(_payload.size());
+		_record.clear();
+		_record.append(reinterpret_cast<const char*>(&size), sizeof(size));
+		_record.push_back(data ? 1 : 0);
+		_record.append(_payload);
+		if(_record.size() > _header->capacity)
+		{
+			throw std::runtime_error("shm_channel: element bigger than the ring");
+		}
+	}
+
+	bool _fits() const
+	{
+		return (_header->capacity - (_header->head.load() - _header->tail.load())) >= _record.size();
+	}
+
+	bool _empty() const
+	{
+		return _header->head.load() == _header->tail.load();
+	}
+
+	bool _try_write()
+	{
+		if(!_fits())
+		{
+			return false;
+		}
+		uint64_t head = _header->head.load();
+		_copy_in(head, _record.data(), _record.size());
+		_header->head.store(head + _record.size());
+		if(_header->readers_waiting.load() > 0)
+		{
+			detail::futex_wake(_header->data_seq);
+		}
+		return true;
+	}
+
+	bool _try_read(optional<T>& data)
+	{
+		if(_empty())
+		{
+			return false;
+		}
+		uint64_t tail = _header->tail.load();
+		uint32_t size;
+		char valid;
+		_copy_out(tail, reinterpret_cast<char*>(&size), sizeof(size));
+		_copy_out(tail + sizeof(size), &valid, 1);
+		_payload.resize(size);
+		_copy_out(tail + sizeof(size) + 1, &_payload[0], size);
+		_header->tail.store(tail + sizeof(size) + 1 + size);
+		if(_header->writers_waiting.load() > 0)
+		{
+			detail::futex_wake(_header->space_seq);
+		}
+		if(valid)
+		{
+			T element(Serializer::read(_payload.data(), _payload.size()));
+			data = optional<T>(element);
+		}
+		else
+		{
+			data = optional<T>(true);
+		}
+		return true;
+	}
+
+	template <typename Predicate>
+	void _wait(std::atomic<uint32_t>& seq, std::atomic<uint32_t>& waiting, Predicate&& ready)
+	{
+		waiting.fetch_add(1);
+		uint32_t expected = seq.load();
+		// recheck after publishing the waiter
+		if(!ready())
+		{
+			detail::futex_wait(seq, expected);
+		}
+		waiting.fetch_sub(1);
+	}
+
+	// the futex wait is done by the watcher of that side, the cpproutine sleeps in the scheduler
+	template <typename Predicate>
+	void _wait(cu::yield_type& yield, detail::futex_watcher* watcher, std::atomic<uint32_t>& seq, std::atomic<uint32_t>& waiting, Predicate&& ready)
+	{
+		assert(watcher && "shm_channel: the versions with yield need the scheduler");
+		waiting.fetch_add(1);
+		uint32_t expected = seq.load();
+		// recheck after publishing the waiter
+		if(!ready())
+		{
+			watcher->wait(yield, seq, expected);
+		}
+		waiting.fetch_sub(1);
+	}
+
+	void _copy_in(uint64_t pos, const char* data, size_t size)
+	{
+		size_t offset = size_t(pos % _header->capacity);
+		size_t first = std::min(size, _header->capacity - offset);
+		memcpy(_ring + offset, data, first);
+		memcpy(_ring, data + first, size - first);
+	}
+
+	void _copy_out(uint64_t pos, char* data, size_t size) const
+	{
+		size_t offset = size_t(pos % _header->capacity);
+		size_t first = std::min(size, _header->capacity - offset);
+		memcpy(data, _ring + offset, first);
+		memcpy(data + first, _ring, size - first);
+	}
+
+protected:
+	std::string _name;
+	bool _owner;
+	detail::shm_header* _header;
+	char* _ring;
+	size_t _size;
+	std::string _record;
+	std::string _payload;
+	// only with scheduler
+	std::unique_ptr<detail::futex_watcher> _readers;
+	std::unique_ptr<detail::futex_watcher> _writers;
+};
+
+}
+
+#endif
+
@@ -0,0 +1,445 @@
+#ifndef _CU_SOCKET_CHANNEL_H_
+#define _CU_SOCKET_CHANNEL_H_
+
+#include <string>
+#include <cstring>
+#include <cerrno>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <stdexcept>
+#include <condition_variable>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netdb.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <coroutine/coroutine.h>
+#include "channel.h"
+#include "spill.h"
+#include "thread_channel.h"
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+namespace cu {
+
+namespace detail {
+
+	// "unix:/tmp/pipeline.sock" or "tcp:127.0.0.1:5555"
+	struct endpoint
+	{
+		explicit endpoint(const std::string& address)
+		{
+			if(address.compare(0, 5, "unix:") == 0)
+			{
+				family = AF_UNIX;
+				path = address.substr(5);
+			}
+			else if(address.compare(0, 4, "tcp:") == 0)
+			{
+				family = AF_INET;
+				auto colon = address.rfind(':');
+				host = address.substr(4, colon - 4);
+				port = address.substr(colon + 1);
+			}
+			else
+			{
+				throw std::runtime_error("invalid endpoint: " + address);
+			}
+		}
+
+		int family;
+		std::string path;
+		std::string host;
+		std::string port;
+	};
+
+	inline void _socket_error(const std::string& what)
+	{
+		throw std::runtime_error(what + ": " + strerror(errno));
+	}
+
+	class socket_handle
+	{
+	public:
+		explicit socket_handle(int fd = -1)
+			: _fd(fd)
+		{
+			if(_fd != -1)
+			{
+				fcntl(_fd, F_SETFL, fcntl(_fd, F_GETFL, 0) | O_NONBLOCK);
+			}
+		}
+
+		~socket_handle()
+		{
+			if(_fd != -1)
+			{
+				::close(_fd);
+			}
+		}
+
+		socket_handle(const socket_handle&) = delete;
+		socket_handle& operator=(const socket_handle&) = delete;
+
+		int get() const
+		{
+			return _fd;
+		}
+
+		void reset(int fd)
+		{
+			if(_fd != -1)
+			{
+				::close(_fd);
+			}
+			_fd = fd;
+			if(_fd != -1)
+			{
+				fcntl(_fd, F_SETFL, fcntl(_fd, F_GETFL, 0) | O_NONBLOCK);
+			}
+		}
+
+	protected:
+		int _fd;
+	};
+
+	// calls f with the address of the endpoint
+	template <typename Function>
+	void _with_address(const endpoint& ep, Function&& f)
+	{
+		if(ep.family == AF_UNIX)
+		{
+			sockaddr_un addr;
+			memset(&addr, 0, sizeof(addr));
+			addr.sun_family = AF_UNIX;
+			strncpy(addr.sun_path, ep.path.c_str(), sizeof(addr.sun_path) - 1);
+			f(reinterpret_cast<sockaddr*>(&addr), socklen_t(sizeof(addr)));
+		}
+		else
+		{
+			addrinfo hints;
+			memset(&hints, 0, sizeof(hints));
+			hints.ai_family = AF_INET;
+			hints.ai_socktype = SOCK_STREAM;
+			addrinfo* result = nullptr;
+			if(getaddrinfo(ep.host.c_str(), ep.port.c_str(), &hints, &result) != 0 || !result)
+			{
+				throw std::runtime_error("can't resolve " + ep.host);
+			}
+			f(result->ai_addr, result->ai_addrlen);
+			freeaddrinfo(result);
+		}
+	}
+
+	inline bool _would_block()
+	{
+		return (errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR);
+	}
+
+	// sleeps in poll() for one cpproutine at a time and wakes it up with notify_remote
+	class fd_watcher
+	{
+	public:
+		explicit fd_watcher(cu::parallel_scheduler& sche)
+			: _waiters(sche)
+			, _fd(-1)
+			, _events(0)
+			, _done(false)
+			, _stop(false)
+		{
+			if(pipe(_wakeup) == -1)
+			{
+				_socket_error("pipe");
+			}
+		}
+
+		~fd_watcher()
+		{
+			if(_thread.joinable())
+			{
+				{
+					std::lock_guard<std::mutex> lock(_mutex);
+					_stop = true;
+				}
+				// unblocks poll()
+				char byte = 0;
+				ssize_t n = write(_wakeup[1], &byte, 1);
+				(void)n;
+				_pending.notify_one();
+				_thread.join();
+			}
+			::close(_wakeup[0]);
+			::close(_wakeup[1]);
+		}
+
+		fd_watcher(const fd_watcher&) = delete;
+		fd_watcher& operator=(const fd_watcher&) = delete;
+
+		// events: POLLIN, POLLOUT. errors and hang ups wake up too, the caller retries the operation
+		void wait(cu::yield_type& yield, int fd, short events)
+		{
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				_fd = fd;
+				_events = events;
+				_done = false;
+				if(!_thread.joinable())
+				{
+					_thread = std::thread([this]() { _loop(); });
+				}
+			}
+			_pending.notify_one();
+			while(!_waiters.wait(yield, [this]() { return _done.load(); }))
+			{
+				;
+			}
+		}
+
+	protected:
+		void _loop()
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			for(;;)
+			{
+				_pending.wait(lock, [this]() { return _stop || (_fd != -1); });
+				if(_stop)
+				{
+					return;
+				}
+				pollfd fds[2];
+				fds[0].fd = _fd;
+				fds[0].events = _events;
+				fds[0].revents = 0;
+				fds[1].fd = _wakeup[0];
+				fds[1].events = POLLIN;
+				fds[1].revents = 0;
+				lock.unlock();
+				poll(fds, 2, -1);
+				lock.lock();
+				_fd = -1;
+				_done = true;
+				_waiters.notify();
+			}
+		}
+
+	protected:
+		coroutine_waiters _waiters;
+		std::thread _thread;
+		std::mutex _mutex;
+		std::condition_variable _pending;
+		int _wakeup[2];
+		int _fd;
+		short _events;
+		std::atomic<bool> _done;
+		bool _stop;
+	};
+
+	// writes all, sleeping while the socket buffer is full
+	inline void _send_all(cu::yield_type& yield, fd_watcher& watcher, int fd, const std::string& data)
+	{
+		size_t sent = 0;
+		while(sent < data.size())
+		{
+			ssize_t n = ::send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+			if(n >= 0)
+			{
+				sent += size_t(n);
+			}
+			else if(_would_block())
+			{
+				watcher.wait(yield, fd, POLLOUT);
+			}
+			else
+			{
+				_socket_error("send");
+			}
+		}
+	}
+}
+
+/*
+serves the elements of chan to the first client connected in endpoint.
+frames: [uint32 size][uint8 valid][payload], payload by cu::serializer<T>.
+frames are batched while chan has elements ready, up to batch_bytes.
+usage: sch.spawn(cu::channel_server(chan, "unix:/tmp/pipeline.sock"));
+*/
+template <typename T, typename Serializer = cu::serializer<T> >
+auto channel_server(cu::channel<T>& chan, const std::string& address, size_t batch_bytes = 64 * 1024)
+{
+	return [&chan, address, batch_bytes](cu::yield_type& yield)
+	{
+		detail::endpoint ep(address);
+		if(ep.family == AF_UNIX)
+		{
+			unlink(ep.path.c_str());
+		}
+		detail::socket_handle listener(socket(ep.family, SOCK_STREAM, 0));
+		if(listener.get() == -1)
+		{
+			detail::_socket_error("socket");
+		}
+		int yes = 1;
+		setsockopt(listener.get(), SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+		detail::_with_address(ep, [&](const sockaddr* addr, socklen_t len) {
+			if(bind(listener.get(), addr, len) == -1)
+			{
+				detail::_socket_error("bind " + address);
+			}
+		});
+		if(listen(listener.get(), 1) == -1)
+		{
+			detail::_socket_error("listen " + address);
+		}
+
+		detail::fd_watcher watcher(chan.get_scheduler());
+		detail::socket_handle client;
+		for(;;)
+		{
+			int fd = accept(listener.get(), nullptr, nullptr);
+			if(fd != -1)
+			{
+				client.reset(fd);
+				break;
+			}
+			if(!detail::_would_block())
+			{
+				detail::_socket_error("accept " + address);
+			}
+			watcher.wait(yield, listener.get(), POLLIN);
+		}
+
+		std::string batch;
+		std::string payload;
+		for(;;)
+		{
+			auto data = chan.get(yield);
+			payload.clear();
+			if(data)
+			{
+				Serializer::write(payload, *data);
+			}
+			uint32_t size = uint32_t(payload.size());
+			batch.append(reinterpret_cast<const char*>(&size), sizeof(size));
+			batch.push_back(data ? 1 : 0);
+			batch.append(payload);
+			if(!data || chan.empty() || (batch.size() >= batch_bytes))
+			{
+				detail::_send_all(yield, watcher, client.get(), batch);
+				batch.clear();
+			}
+			if(!data)
+			{
+				break; // close is forwarded
+			}
+		}
+		if(ep.family == AF_UNIX)
+		{
+			unlink(ep.path.c_str());
+		}
+	};
+}
+
+/*
+connects to a channel_server and sends every element received to chan
+(through the pipeline of chan), the remote close closes chan.
+while the server isn't listening the connect is retried every retry.
+usage: sch.spawn(cu::channel_client("unix:/tmp/pipeline.sock", chan));
+*/
+template <typename T, typename Serializer = cu::serializer<T> >
+auto channel_client(const std::string& address, cu::channel<T>& chan, size_t read_bytes = 64 * 1024, fes::deltatime retry = fes::deltatime(10))
+{
+	return [&chan, address, read_bytes, retry](cu::yield_type& yield)
+	{
+		detail::endpoint ep(address);
+		detail::fd_watcher watcher(chan.get_scheduler());
+		detail::socket_handle server;
+		for(;;)
+		{
+			server.reset(socket(ep.family, SOCK_STREAM, 0));
+			if(server.get() == -1)
+			{
+				detail::_socket_error("socket");
+			}
+			int error = 0;
+			detail::_with_address(ep, [&](const sockaddr* addr, socklen_t len) {
+				error = (connect(server.get(), addr, len) == 0) ? 0 : errno;
+			});
+			if(error == EINPROGRESS)
+			{
+				// tcp: the result is known when the socket is writable
+				watcher.wait(yield, server.get(), POLLOUT);
+				socklen_t len = sizeof(error);
+				if(getsockopt(server.get(), SOL_SOCKET, SO_ERROR, &error, &len) == -1)
+				{
+					error = errno;
+				}
+			}
+			if(error == 0)
+			{
+				break;
+			}
+			if((error != ECONNREFUSED) && (error != ENOENT) && (error != EAGAIN))
+			{
+				errno = error;
+				detail::_socket_error("connect " + address);
+			}
+			// server not listening yet
+			chan.get_scheduler().sleep_for(yield, retry);
+		}
+
+		std::string buffer;
+		std::vector<char> chunk(read_bytes);
+		size_t parsed = 0;
+		for(;;)
+		{
+			ssize_t n = recv(server.get(), chunk.data(), chunk.size(), 0);
+			if(n > 0)
+			{
+				buffer.append(chunk.data(), size_t(n));
+			}
+			else if(n == 0)
+			{
+				throw std::runtime_error("channel_client: connection closed without close mark");
+			}
+			else if(detail::_would_block())
+			{
+				watcher.wait(yield, server.get(), POLLIN);
+				continue;
+			}
+			else
+			{
+				detail::_socket_error("recv " + address);
+			}
+			// decode all the complete frames
+			const size_t header = sizeof(uint32_t) + 1;
+			while(buffer.size() - parsed >= header)
+			{
+				uint32_t size;
+				memcpy(&size, buffer.data() + parsed, sizeof(size));
+				if(buffer.size() - parsed < header + size)
+					break;
+				bool valid = buffer[parsed + sizeof(size)] != 0;
+				const char* payload = buffer.data() + parsed + header;
+				parsed += header + size;
+				if(!valid)
+				{
+					chan.close(yield);
+					return;
+				}
+				chan(yield, Serializer::read(payload, size));
+			}
+			buffer.erase(0, parsed);
+			parsed = 0;
+		}
+	};
+}
+
+}
+
+#endif
+
@@ -0,0 +1,187 @@
+#ifndef _CU_SPILL_H_
+#define _CU_SPILL_H_
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <memory>
+#include <exception>
+#include <stdexcept>
+#include <type_traits>
+#include <algorithm>
+#include "channel.h"
+
+namespace cu {
+
+/*
+bytes <-> T, used by the channels that leave the memory (spill_file, ...).
+valid for trivially copyable types, specialize it for the rest:
+
+template <>
+struct serializer<my_type>
+{
+	static void write(std::string& out, const my_type& data);
+	static my_type read(const char* data, size_t size);
+};
+*/
+template <typename T>
+struct serializer
+{
+	static_assert(std::is_trivially_copyable<T>::value, "specialize cu::serializer<T> for this type");
+
+	static void write(std::string& out, const T& data)
+	{
+		out.append(reinterpret_cast<const char*>(&data), sizeof(T));
+	}
+
+	static T read(const char* data, size_t size)
+	{
+		T result;
+		memcpy(&result, data, std::min(size, sizeof(T)));
+		return result;
+	}
+};
+
+template <>
+struct serializer<std::string>
+{
+	static void write(std::string& out, const std::string& data)
+	{
+		out.append(data);
+	}
+
+	static std::string read(const char* data, size_t size)
+	{
+		return std::string(data, size);
+	}
+};
+
+/*
+append-only temporary file, records are read back in order.
+each record: [uint32 size][uint8 valid][payload]
+writes are batched in memory until flush_bytes.
+*/
+template <typename T, typename Serializer = cu::serializer<T> >
+class spill_file : public overflow_storage<T>
+{
+public:
+	explicit spill_file(size_t flush_bytes = 64 * 1024)
+		: _file(tmpfile())
+		, _flush_bytes(flush_bytes)
+		, _read_pos(0)
+		, _write_pos(0)
+		, _count(0)
+	{
+		if(!_file)
+		{
+			throw std::runtime_error("spill_file: can't create temporary file");
+		}
+	}
+
+	~spill_file()
+	{
+		fclose(_file);
+	}
+
+	spill_file(const spill_file&) = delete;
+	spill_file& operator=(const spill_file&) = delete;
+
+	void push(const optional<T>& data) override
+	{
+		_payload.clear();
+		if(data)
+		{
+			Serializer::write(_payload, *data);
+		}
+		uint32_t size = uint32_t(_payload.size());
+		char valid = data ? 1 : 0;
+		_pending.append(reinterpret_cast<const char*>(&size), sizeof(size));
+		_pending.push_back(valid);
+		_pending.append(_payload);
+		++_count;
+		if(_pending.size() >= _flush_bytes)
+		{
+			_flush();
+		}
+	}
+
+	optional<T> pop() override
+	{
+		assert(_count > 0);
+		if(_read_pos == _write_pos)
+		{
+			// all the file is consumed, the next record is still in memory
+			_flush();
+		}
+		fseek(_file, long(_read_pos), SEEK_SET);
+		uint32_t size;
+		char valid;
+		_read(reinterpret_cast<char*>(&size), sizeof(size));
+		_read(&valid, 1);
+		_payload.resize(size);
+		_read(&_payload[0], size);
+		_read_pos += sizeof(size) + 1 + size;
+		--_count;
+		if(_count == 0)
+		{
+			// reuse the file from the beginning
+			_read_pos = _write_pos = 0;
+		}
+		if(!valid)
+		{
+			return optional<T>(true);
+		}
+		T data(Serializer::read(_payload.data(), _payload.size()));
+		return optional<T>(data);
+	}
+
+	size_t size() const override
+	{
+		return _count;
+	}
+
+protected:
+	void _flush()
+	{
+		if(_pending.empty())
+		{
+			return;
+		}
+		fseek(_file, long(_write_pos), SEEK_SET);
+		if(fwrite(_pending.data(), 1, _pending.size(), _file) != _pending.size())
+		{
+			throw std::runtime_error("spill_file: write error");
+		}
+		_write_pos += _pending.size();
+		_pending.clear();
+	}
+
+	void _read(char* data, size_t size)
+	{
+		if((size > 0) && (fread(data, 1, size, _file) != size))
+		{
+			throw std::runtime_error("spill_file: read error");
+		}
+	}
+
+protected:
+	FILE* _file;
+	size_t _flush_bytes;
+	size_t _read_pos;
+	size_t _write_pos;
+	size_t _count;
+	std::string _pending;
+	std::string _payload;
+};
+
+// the producer never blocks, elements past watermark go to a temporary file
+template <typename T, typename Serializer = cu::serializer<T> >
+void spill_to_disk(cu::channel<T>& chan, size_t watermark)
+{
+	chan.spill(watermark, std::make_unique< cu::spill_file<T, Serializer> >());
+}
+
+}
+
+#endif
+
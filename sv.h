@@ -0,0 +1,286 @@
+#ifndef _CU_SV_H_
+#define _CU_SV_H_
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdio>
+#include <cstring>
+#include <cctype>
+#include <boost/regex.hpp>
+#include <boost/utility/string_view.hpp>
+#include "channel.h"
+#include "shell.h"
+#include "block.h"
+#include "reader.h"
+
+namespace cu {
+
+/*
+a line that doesn't own its bytes: a view into a read buffer (or mapped file, see
+reader.h) shared by all the lines of that buffer. grep, contain, strip and cut pass views (a refcount, no
+allocation), the copy is done only by the sinks that need a std::string:
+
+cu::ch_sv c(sch, 10);
+c.pipeline(sv::cat(), sv::grep("*error*"), sv::cut(2), sv::out(strs));
+c("app.log");
+
+a view is valid while the element (or a copy of it) is alive.
+*/
+class line_view
+{
+public:
+	line_view()
+	{
+		;
+	}
+
+	// an owned line, lets ch_sv be fed like ch_str: c("file.log")
+	line_view(const std::string& line)
+		: line_view(std::make_shared<const std::string>(line))
+	{
+		;
+	}
+
+	explicit line_view(const std::shared_ptr<const std::string>& line)
+		: line_view(boost::string_view(*line), line)
+	{
+		;
+	}
+
+	line_view(const char* line)
+		: line_view(std::string(line))
+	{
+		;
+	}
+
+	// owner keeps the bytes of text alive (a read buffer, a mapped file ...)
+	line_view(boost::string_view text, const std::shared_ptr<const void>& owner)
+		: _buffer(owner)
+		, _text(text)
+	{
+		;
+	}
+
+	boost::string_view view() const
+	{
+		return _text;
+	}
+
+	std::string str() const
+	{
+		return std::string(_text.data(), _text.size());
+	}
+
+	// a part of this line, same buffer
+	line_view sub(boost::string_view part) const
+	{
+		return line_view(part, _buffer);
+	}
+
+	const char* data() const
+	{
+		return _text.data();
+	}
+
+	size_t size() const
+	{
+		return _text.size();
+	}
+
+protected:
+	std::shared_ptr<const void> _buffer;
+	boost::string_view _text;
+};
+
+using ch_sv = cu::channel<line_view>;
+
+namespace sv {
+
+namespace detail {
+
+	inline bool is_space(char c)
+	{
+		return std::isspace(static_cast<unsigned char>(c)) != 0;
+	}
+}
+
+ch_sv::link cat(const std::string& filename)
+{
+	return [=](ch_sv::in&, ch_sv::out& yield)
+	{
+		read_lines(filename, [&](const char* data, size_t length, const std::shared_ptr<const void>& owner) {
+			yield(line_view(boost::string_view(data, length), owner));
+		});
+	};
+}
+
+// each input line is a filename
+ch_sv::link cat()
+{
+	return [&](ch_sv::in& source, ch_sv::out& yield)
+	{
+		for (auto& s : source)
+		{
+			if(s)
+			{
+				cat((*s).str())(source, yield);
+			}
+			else
+			{
+				yield(s);
+			}
+		}
+	};
+}
+
+ch_sv::link grep(const char* pattern, bool exclusion = false)
+{
+	return [=](ch_sv::in& source, ch_sv::out& yield)
+	{
+		const boost::regex re(translate(pattern));
+		boost::match_results<const char*> groups;
+		for (auto& s : source)
+		{
+			if(s)
+			{
+				const char* line = (*s).data();
+				if ((boost::regex_search(line, line + (*s).size(), groups, re) && (groups.size() > 0)) == !exclusion)
+				{
+					yield(s);
+				}
+			}
+			else
+			{
+				yield(s);
+			}
+		}
+	};
+}
+
+ch_sv::link contain(const std::string& in)
+{
+	return [=](ch_sv::in& source, ch_sv::out& yield)
+	{
+		for (auto& s : source)
+		{
+			if(s)
+			{
+				if ((*s).view().find(in) != boost::string_view::npos)
+				{
+					yield(s);
+				}
+			}
+			else
+			{
+				yield(s);
+			}
+		}
+	};
+}
+
+ch_sv::link strip()
+{
+	return [=](ch_sv::in& source, ch_sv::out& yield)
+	{
+		for (auto& s : source)
+		{
+			if(s)
+			{
+				boost::string_view line((*s).view());
+				size_t left = 0;
+				size_t right = line.size();
+				while((left < right) && detail::is_space(line[left]))
+					++left;
+				while((right > left) && detail::is_space(line[right - 1]))
+					--right;
+				yield((*s).sub(line.substr(left, right - left)));
+			}
+			else
+			{
+				yield(s);
+			}
+		}
+	};
+}
+
+ch_sv::link cut(int field, const char* delim = " ")
+{
+	return [=](ch_sv::in& source, ch_sv::out& yield)
+	{
+		for (auto& s : source)
+		{
+			if(s)
+			{
+				const char* first;
+				size_t n;
+				if(block::detail::token((*s).data(), (*s).size(), field, delim, first, n))
+				{
+					yield((*s).sub(boost::string_view(first, n)));
+				}
+			}
+			else
+			{
+				yield(s);
+			}
+		}
+	};
+}
+
+ch_sv::link count()
+{
+	return [=](ch_sv::in& source, ch_sv::out& yield)
+	{
+		size_t total = 0;
+		for (auto& s : source)
+		{
+			if(s)
+			{
+				++total;
+			}
+			else if(s.failed())
+			{
+				yield(s);
+			}
+		}
+		yield(line_view(std::to_string(total)));
+	};
+}
+
+// the copy to std::string is done here, at the sink
+ch_sv::link out(std::vector<std::string>& strs)
+{
+	return [&](ch_sv::in& source, ch_sv::out& yield)
+	{
+		for (auto& s : source)
+		{
+			if(s)
+			{
+				strs.emplace_back((*s).str());
+			}
+			yield(s);
+		}
+	};
+}
+
+ch_sv::link out(std::string& str)
+{
+	return [&](ch_sv::in& source, ch_sv::out& yield)
+	{
+		for (auto& s : source)
+		{
+			if(s)
+			{
+				str = (*s).str();
+			}
+			yield(s);
+		}
+	};
+}
+
+}
+
+}
+
+#endif
+
@@ -0,0 +1,202 @@
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <gtest/gtest.h>
+#include <boost/filesystem.hpp>
+#include "../shell.h"
+#include "../parallel_scheduler.h"
+#include "../channel.h"
+#include "../fused.h"
+#include "../pipeline.h"
+#include "../sv.h"
+#include "../async_io.h"
+
+class BenchPipeline : testing::Test { };
+
+using namespace cu;
+
+namespace {
+
+	// unique directory in the temp dir, removed with its content
+	struct scratch_dir
+	{
+		scratch_dir()
+			: path(boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("cppunix_bench_%%%%-%%%%-%%%%"))
+		{
+			boost::filesystem::create_directories(path);
+		}
+
+		~scratch_dir()
+		{
+			boost::system::error_code ec;
+			boost::filesystem::remove_all(path, ec);
+		}
+
+		std::string file(const std::string& name) const
+		{
+			return (path / name).string();
+		}
+
+		boost::filesystem::path path;
+	};
+
+	std::string write_bench_file(const scratch_dir& dir, int lines)
+	{
+		std::string bench_file = dir.file("bench_pipeline.log");
+		std::ofstream out(bench_file);
+		for(int i=0; i<lines; ++i)
+		{
+			out << "line " << i << " " << ((i % 3) ? "info" : "error") << " value=" << i * 7 << std::endl;
+		}
+		return bench_file;
+	}
+
+	template <typename Function>
+	double measure(Function&& f)
+	{
+		auto start = std::chrono::steady_clock::now();
+		f();
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+TEST(BenchPipeline, fused_vs_links)
+{
+	scratch_dir dir;
+	std::string bench_file = write_bench_file(dir, 200000);
+	cu::parallel_scheduler sch;
+
+	std::string links_result;
+	cu::channel<std::string> c1(sch, 10);
+	c1.pipeline(cat(), grep("*error*"), cut(2), quote(), count(), out(links_result));
+	double links_ms = measure([&]() { c1(bench_file); });
+
+	std::string fused_result;
+	cu::channel<std::string> c2(sch, 10);
+	c2.pipeline(fused::cat() | fused::grep("*error*") | fused::cut(2) | fused::quote() | fused::count(), out(fused_result));
+	double fused_ms = measure([&]() { c2(bench_file); });
+
+	std::cout << "links: " << links_ms << " ms, fused: " << fused_ms << " ms" << std::endl;
+	ASSERT_EQ(links_result, "66667");
+	ASSERT_EQ(fused_result, links_result);
+}
+
+TEST(BenchPipeline, inline_pipeline_vs_channel)
+{
+	scratch_dir dir;
+	std::string bench_file = write_bench_file(dir, 200000);
+	cu::parallel_scheduler sch;
+
+	// count() keeps the channel from blocking without consumers
+	std::vector<std::string> channel_result;
+	cu::channel<std::string> c1(sch, 10);
+	c1.pipeline(cat(), grep("*error*"), cut(2), out(channel_result), count());
+	double channel_ms = measure([&]() { c1(bench_file); });
+
+	std::vector<std::string> inline_result;
+	cu::pipeline<std::string> p(cat(), grep("*error*"), cut(2));
+	p.sink([&](const std::string& s) { inline_result.emplace_back(s); });
+	double inline_ms = measure([&]() { p(bench_file); });
+
+	std::cout << "channel: " << channel_ms << " ms, inline: " << inline_ms << " ms" << std::endl;
+	ASSERT_EQ(inline_result.size(), 66667);
+	ASSERT_EQ(inline_result, channel_result);
+}
+
+TEST(BenchPipeline, string_view_vs_links)
+{
+	scratch_dir dir;
+	std::string bench_file = write_bench_file(dir, 200000);
+	cu::parallel_scheduler sch;
+
+	std::string links_result;
+	cu::channel<std::string> c1(sch, 10);
+	c1.pipeline(cat(), grep("*error*"), strip(), cut(2), count(), out(links_result));
+	double links_ms = measure([&]() { c1(bench_file); });
+
+	std::string sv_result;
+	cu::ch_sv c2(sch, 10);
+	c2.pipeline(sv::cat(), sv::grep("*error*"), sv::strip(), sv::cut(2), sv::count(), sv::out(sv_result));
+	double sv_ms = measure([&]() { c2(bench_file); });
+
+	std::cout << "links: " << links_ms << " ms, string_view: " << sv_ms << " ms" << std::endl;
+	ASSERT_EQ(links_result, "66667");
+	ASSERT_EQ(sv_result, links_result);
+}
+
+TEST(BenchPipeline, cat_async_many_files)
+{
+	scratch_dir dir;
+	std::string bench_files = dir.file("bench_files");
+	boost::filesystem::create_directory(bench_files);
+	for(int i=0; i<2000; ++i)
+	{
+		std::ofstream file(bench_files + "/" + std::to_string(i) + ".log");
+		for(int j=0; j<20; ++j)
+		{
+			file << "file " << i << " line " << j << ((j % 3) ? " info" : " error") << std::endl;
+		}
+	}
+	cu::parallel_scheduler sch;
+
+	std::string cat_result;
+	cu::channel<std::string> c1(sch, 10);
+	c1.pipeline(find(), cat(), grep("*error*"), count(), out(cat_result));
+	double cat_ms = measure([&]() { c1(bench_files); });
+
+	std::string async_result;
+	cu::channel<std::string> c2(sch, 10);
+	c2.pipeline(find(), cat_async(64), grep("*error*"), count(), out(async_result));
+	double async_ms = measure([&]() { c2(bench_files); });
+
+	std::cout << "cat: " << cat_ms << " ms, cat_async: " << async_ms << " ms" << std::endl;
+	ASSERT_EQ(cat_result, "14000");
+	ASSERT_EQ(async_result, cat_result);
+
+	// files without a size and missing files go through the same submit
+	cu::async_reader reader(sch, 4);
+	std::string status;
+	int missing = 0;
+	sch.spawn([&](auto& yield) {
+		auto proc = reader.submit("/proc/self/status");
+		auto none = reader.submit(bench_files + "/missing.log");
+		reader.wait(yield, proc);
+		reader.wait(yield, none);
+		status = proc->data;
+		missing = none->error;
+	});
+	sch.run_until_complete();
+	ASSERT_NE(status.find("Name:"), std::string::npos);
+	ASSERT_EQ(missing, ENOENT);
+}
+
+TEST(BenchPipeline, fused_mixed_with_links)
+{
+	scratch_dir dir;
+	std::string bench_file = write_bench_file(dir, 1000);
+	cu::parallel_scheduler sch;
+
+	std::vector<std::string> strs;
+	cu::channel<std::string> c1(sch, 10);
+	c1.pipeline(
+			  fused::cat() | fused::contain("error") | fused::map([](const std::string& s) { return s.substr(0, 6); })
+			, head(3)
+			, fused::filter([](const std::string& s) { return s != "line 3"; }) | fused::quote("'")
+			, out(strs)
+	);
+	c1(bench_file);
+	ASSERT_EQ(strs.size(), 2);
+	ASSERT_EQ(strs[0], "'line 0'");
+	ASSERT_EQ(strs[1], "'line 6'");
+
+	// the stages own their parameters, the chain outlives the strings used to build it
+	auto values = []() {
+		std::string delim("=");
+		return fused::contain("line 3 ") | fused::cut(1, delim.c_str());
+	}();
+	strs.clear();
+	cu::channel<std::string> c2(sch, 10);
+	c2.pipeline(cat(), values, out(strs));
+	c2(bench_file);
+	ASSERT_EQ(strs, std::vector<std::string>({"21"}));
+}
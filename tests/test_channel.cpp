@@ -3,7 +3,18 @@
 #include "../channel.h"
 #include "../parallel_scheduler.h"
 #include "../shell.h"
+#include "../broadcast_channel.h"
+#include "../thread_channel.h"
+#include "../spill.h"
+#include "../shm_channel.h"
+#include "../socket_channel.h"
+#include "../ticker.h"
+#include "../timing.h"
 #include <thread>
+#include <ctime>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
 #include <asyncply/run.h>
 
 class ChannelTest : testing::Test { };
@@ -100,3 +111,745 @@ TEST(CoroTest, TestScheduler)
 	sch.run_until_complete();
 }
 
+
+TEST(ChannelTest, stats)
+{
+	cu::parallel_scheduler sch;
+	cu::channel<int> go(sch, 5);
+	go.set_name("numbers");
+	go.enable_stats();
+	// the consumer waits the first element, then it is slower than the producer
+	sch.spawn([&](auto& yield) {
+		for(auto& data : cu::range(yield, go))
+		{
+			(void)data;
+			yield(cu::control_type{});
+			yield(cu::control_type{});
+		}
+	});
+	sch.spawn([&](auto& yield) {
+		for(int i=0; i<50; ++i) {
+			go(yield, i);
+		}
+		go.close(yield);
+	});
+	sch.run_until_complete();
+	auto stats = go.stats();
+	ASSERT_GT(stats.producer_blocked.count(), 0);
+	ASSERT_GT(stats.consumer_blocked.count(), 0);
+	ASSERT_EQ(stats.name, "numbers");
+	ASSERT_EQ(stats.buffer, 5);
+	ASSERT_EQ(stats.elements_in, 50);
+	ASSERT_EQ(stats.elements_out, 50);
+	ASSERT_EQ(stats.occupancy.size(), 7);
+	size_t pushes = 0;
+	for(auto n : stats.occupancy)
+	{
+		pushes += n;
+	}
+	ASSERT_EQ(pushes, 50);
+}
+
+TEST(ChannelTest, broadcast)
+{
+	cu::parallel_scheduler sch;
+	cu::broadcast_channel<int> bc(sch, 4);
+	std::vector<int> totals(6, 0);
+	for(size_t i=0; i<totals.size(); ++i)
+	{
+		auto id = bc.subscribe();
+		sch.spawn([&, id](auto& yield) {
+			for(auto& data : cu::range(yield, bc, id))
+			{
+				totals[id] += data;
+			}
+		});
+	}
+	sch.spawn([&](auto& yield) {
+		for(int i=1; i<=100; ++i) {
+			bc(yield, i);
+		}
+		bc.close(yield);
+	});
+	sch.run_until_complete();
+	for(auto total : totals)
+	{
+		ASSERT_EQ(total, 5050);
+	}
+}
+
+TEST(ChannelTest, broadcast_drop_lagging)
+{
+	cu::parallel_scheduler sch;
+	cu::broadcast_channel<int> bc(sch, 3, true);
+	cu::semaphore done(sch);
+	auto fast = bc.subscribe();
+	auto slow = bc.subscribe();
+	std::vector<int> fast_recv;
+	std::vector<int> slow_recv;
+	sch.spawn([&](auto& yield) {
+		for(auto& data : cu::range(yield, bc, fast))
+		{
+			fast_recv.emplace_back(data);
+		}
+	});
+	sch.spawn([&](auto& yield) {
+		done.wait(yield);
+		for(auto& data : cu::range(yield, bc, slow))
+		{
+			slow_recv.emplace_back(data);
+		}
+	});
+	sch.spawn([&](auto& yield) {
+		for(int i=0; i<20; ++i) {
+			bc(yield, i);
+		}
+		bc.close(yield);
+		done.notify(yield);
+	});
+	sch.run_until_complete();
+	ASSERT_EQ(fast_recv.size(), 20);
+	ASSERT_EQ(bc.dropped(fast), 0);
+	ASSERT_EQ(slow_recv, std::vector<int>({17, 18, 19}));
+	ASSERT_EQ(bc.dropped(slow), 17);
+}
+
+TEST(ChannelTest, merge)
+{
+	cu::parallel_scheduler sch;
+	cu::channel<int> fast(sch, 10);
+	cu::channel<int> slow(sch, 10);
+	std::vector<int> recv;
+	sch.spawn([&](auto& yield) {
+		for(auto& data : cu::merge(yield, fast, slow))
+		{
+			recv.emplace_back(data);
+		}
+	});
+	sch.spawn([&](auto& yield) {
+		for(int i=0; i<30; ++i) {
+			fast(yield, i);
+		}
+		fast.close(yield);
+	});
+	sch.spawn([&](auto& yield) {
+		for(int i=100; i<103; ++i) {
+			cu::sleep(yield, fes::deltatime(5));
+			slow(yield, i);
+		}
+		slow.close(yield);
+	});
+	sch.run_until_complete();
+	ASSERT_EQ(recv.size(), 33);
+	// the slow channel does not gate the fast one
+	ASSERT_EQ(std::find(recv.begin(), recv.end(), 29) - recv.begin(), 29);
+}
+
+TEST(ChannelTest, merge_sorted)
+{
+	cu::parallel_scheduler sch;
+	cu::channel<int> c1(sch, 10);
+	cu::channel<int> c2(sch, 10);
+	cu::channel<int> c3(sch, 10);
+	std::vector<int> recv;
+	sch.spawn([&](auto& yield) {
+		for(auto& data : cu::merge_sorted(yield, std::less<int>(), c1, c2, c3))
+		{
+			recv.emplace_back(data);
+		}
+	});
+	auto shard = [&](cu::channel<int>& chan, int first) {
+		sch.spawn([&chan, first](auto& yield) {
+			for(int i=first; i<60; i+=3) {
+				chan(yield, i);
+			}
+			chan.close(yield);
+		});
+	};
+	shard(c1, 0);
+	shard(c2, 1);
+	shard(c3, 2);
+	sch.run_until_complete();
+	ASSERT_EQ(recv.size(), 60);
+	ASSERT_TRUE(std::is_sorted(recv.begin(), recv.end()));
+}
+
+TEST(ChannelTest, thread_channel)
+{
+	cu::parallel_scheduler sch;
+	cu::thread_channel<int> from_threads(sch, 16);
+	cu::thread_channel<int> to_threads(sch, 16);
+	std::vector<std::thread> producers;
+	for(int p=0; p<4; ++p)
+	{
+		producers.emplace_back([&]() {
+			for(int i=1; i<=1000; ++i) {
+				from_threads.send(i);
+			}
+		});
+	}
+	std::thread consumer([&]() {
+		int total = 0;
+		for(auto data = to_threads.get(); data; data = to_threads.get())
+		{
+			total += *data;
+		}
+		ASSERT_EQ(total, 4 * 500500);
+	});
+	sch.spawn([&](auto& yield) {
+		int received = 0;
+		while(received < 4000)
+		{
+			auto data = from_threads.get(yield);
+			to_threads(yield, *data);
+			++received;
+		}
+		to_threads.close(yield);
+	});
+	sch.run_until_complete();
+	for(auto& producer : producers)
+	{
+		producer.join();
+	}
+	consumer.join();
+}
+
+TEST(ChannelTest, spill_to_disk)
+{
+	cu::parallel_scheduler sch;
+	cu::channel<std::string> go(sch, 2);
+	go.pipeline(cu::quote());
+	cu::spill_to_disk(go, 4);
+	go.enable_stats();
+	cu::semaphore done(sch);
+	std::vector<std::string> recv;
+	sch.spawn([&](auto& yield) {
+		// never blocks, the consumer is not running yet
+		for(int i=0; i<5000; ++i) {
+			go(yield, std::to_string(i));
+		}
+		go.close(yield);
+		done.notify(yield);
+	});
+	sch.spawn([&](auto& yield) {
+		done.wait(yield);
+		for(auto& data : cu::range(yield, go))
+		{
+			recv.emplace_back(data);
+		}
+	});
+	sch.run_until_complete();
+	ASSERT_EQ(recv.size(), 5000);
+	for(int i=0; i<5000; ++i)
+	{
+		ASSERT_EQ(recv[i], "\"" + std::to_string(i) + "\"");
+	}
+	// the close mark is spilled too, but not counted
+	ASSERT_EQ(go.stats().spilled, 4996);
+}
+
+TEST(ChannelTest, shm_channel)
+{
+	std::string name = "/cppunix_test_" + std::to_string(getpid());
+	cu::shm_channel<std::string> writer(name, cu::shm_mode::create, 4096);
+	cu::shm_channel<std::string> reader(name);
+	std::thread producer([&]() {
+		for(int i=0; i<20000; ++i) {
+			writer.send(std::to_string(i));
+		}
+		writer.close();
+	});
+	int i = 0;
+	for(auto data = reader.get(); data; data = reader.get())
+	{
+		ASSERT_EQ(*data, std::to_string(i++));
+	}
+	producer.join();
+	ASSERT_EQ(i, 20000);
+
+	// cpproutines sleep in the scheduler while a watcher thread waits the futex
+	cu::parallel_scheduler sch;
+	cu::shm_channel<int> numbers(sch, name + "_int", cu::shm_mode::create, 64);
+	int total = 0;
+	sch.spawn([&](auto& yield) {
+		for(auto data = numbers.get(yield); data; data = numbers.get(yield))
+		{
+			total += *data;
+		}
+	});
+	sch.spawn([&](auto& yield) {
+		for(int n=1; n<=100; ++n) {
+			numbers(yield, n);
+		}
+		numbers.close(yield);
+	});
+	sch.run_until_complete();
+	ASSERT_EQ(total, 5050);
+}
+
+TEST(ChannelTest, shm_channel_fork)
+{
+	std::string name = "/cppunix_fork_" + std::to_string(getpid());
+	cu::parallel_scheduler sch;
+	cu::shm_channel<std::string> reader(sch, name, cu::shm_mode::create, 256);
+	pid_t child = fork();
+	ASSERT_NE(child, -1);
+	if(child == 0)
+	{
+		// other process: only the thread versions, _exit skips the destructors of the parent objects
+		cu::shm_channel<std::string> writer(name);
+		for(int i=0; i<5000; ++i) {
+			writer.send(std::to_string(i));
+		}
+		writer.close();
+		_exit(0);
+	}
+	int i = 0;
+	bool in_order = true;
+	sch.spawn([&](auto& yield) {
+		for(auto data = reader.get(yield); data; data = reader.get(yield))
+		{
+			in_order = in_order && (*data == std::to_string(i++));
+		}
+	});
+	sch.run_until_complete();
+	int status = 0;
+	ASSERT_EQ(waitpid(child, &status, 0), child);
+	ASSERT_TRUE(WIFEXITED(status));
+	ASSERT_EQ(WEXITSTATUS(status), 0);
+	ASSERT_TRUE(in_order);
+	ASSERT_EQ(i, 5000);
+}
+
+TEST(ChannelTest, socket_channel)
+{
+	std::string endpoint = "unix:/tmp/cppunix_test_" + std::to_string(getpid()) + ".sock";
+	cu::parallel_scheduler sch;
+	cu::channel<std::string> local(sch, 10);
+	cu::channel<std::string> remote(sch, 10);
+	remote.pipeline(cu::quote("<"));
+	sch.spawn(cu::channel_server(local, endpoint));
+	sch.spawn(cu::channel_client(endpoint, remote));
+	sch.spawn([&](auto& yield) {
+		for(int i=0; i<1000; ++i) {
+			local(yield, std::to_string(i));
+		}
+		local.close(yield);
+	});
+	int i = 0;
+	sch.spawn([&](auto& yield) {
+		for(auto& data : cu::range(yield, remote))
+		{
+			ASSERT_EQ(data, "<" + std::to_string(i++) + "<");
+		}
+	});
+	sch.run_until_complete();
+	ASSERT_EQ(i, 1000);
+}
+
+namespace {
+
+// a tcp port nobody listens now
+int free_tcp_port()
+{
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = 0;
+	bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+	socklen_t len = sizeof(addr);
+	getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &len);
+	close(fd);
+	return ntohs(addr.sin_port);
+}
+
+}
+
+TEST(ChannelTest, socket_channel_tcp)
+{
+	std::string endpoint = "tcp:127.0.0.1:" + std::to_string(free_tcp_port());
+	cu::parallel_scheduler sch;
+	cu::channel<int> local(sch, 10);
+	cu::channel<int> remote(sch, 10);
+	// the client starts first: the refused connects are retried
+	sch.spawn(cu::channel_client(endpoint, remote));
+	sch.spawn([&](auto& yield) {
+		sch.sleep_for(yield, fes::deltatime(30));
+		cu::channel_server(local, endpoint)(yield);
+	});
+	sch.spawn([&](auto& yield) {
+		for(int i=0; i<10000; ++i) {
+			local(yield, i);
+		}
+		local.close(yield);
+	});
+	int64_t total = 0;
+	int n = 0;
+	sch.spawn([&](auto& yield) {
+		for(auto& data : cu::range(yield, remote))
+		{
+			total += data;
+			++n;
+		}
+	});
+	sch.run_until_complete();
+	ASSERT_EQ(n, 10000);
+	ASSERT_EQ(total, int64_t(9999) * 10000 / 2);
+}
+
+TEST(ChannelTest, adaptive_buffer)
+{
+	cu::parallel_scheduler sch;
+
+	// the producer is faster: the buffer grows up to the cap
+	cu::channel<int> fast(sch, 1);
+	fast.set_adaptive(1, 32, 16);
+	std::vector<int> seen;
+	sch.spawn([&](auto& yield) {
+		for(int i=0; i<1000; ++i) {
+			fast(yield, i);
+		}
+		fast.close(yield);
+	});
+	sch.spawn([&](auto& yield) {
+		for(auto& data : cu::range(yield, fast))
+		{
+			seen.push_back(data);
+			yield(cu::control_type{});
+		}
+	});
+	sch.run_until_complete();
+	ASSERT_EQ(seen.size(), 1000);
+	ASSERT_TRUE(std::is_sorted(seen.begin(), seen.end()));
+	ASSERT_EQ(fast.get_buffer(), 32);
+
+	// the consumer is waiting all the time: the buffer shrinks to the minimum
+	cu::channel<int> idle(sch, 64);
+	idle.set_adaptive(2, 64, 16);
+	size_t received = 0;
+	sch.spawn([&](auto& yield) {
+		for(auto& data : cu::range(yield, idle))
+		{
+			(void)data;
+			++received;
+		}
+	});
+	sch.spawn([&](auto& yield) {
+		for(int i=0; i<1000; ++i) {
+			idle(yield, i);
+			yield(cu::control_type{});
+		}
+		idle.close(yield);
+	});
+	sch.run_until_complete();
+	ASSERT_EQ(received, 1000);
+	ASSERT_EQ(idle.get_buffer(), 2);
+}
+
+TEST(ChannelTest, overflow_policy)
+{
+	cu::parallel_scheduler sch;
+
+	cu::channel<int> newest(sch, 2);
+	newest.enable_stats();
+	newest.set_policy(cu::overflow_policy::drop_newest);
+	for(int i=0; i<10; ++i) {
+		newest(i);
+	}
+	ASSERT_EQ(*newest.get(), 0);
+	ASSERT_EQ(*newest.get(), 1);
+	ASSERT_EQ(*newest.get(), 2);
+	ASSERT_TRUE(newest.empty());
+	ASSERT_EQ(newest.stats().dropped, 7);
+
+	cu::channel<int> ring(sch, 2);
+	ring.enable_stats();
+	ring.set_policy(cu::overflow_policy::overwrite_oldest);
+	for(int i=0; i<10; ++i) {
+		ring(i);
+	}
+	ASSERT_EQ(*ring.get(), 7);
+	ASSERT_EQ(*ring.get(), 8);
+	ASSERT_EQ(*ring.get(), 9);
+	ASSERT_TRUE(ring.empty());
+	ASSERT_EQ(ring.stats().overwritten, 7);
+
+	// latest value per sensor
+	cu::channel<std::string> latest(sch, 10);
+	latest.enable_stats();
+	latest.conflate([](const std::string& s) { return s.substr(0, s.find('=')); });
+	for(auto& s : {"a=1", "b=1", "a=2", "c=1", "b=2", "a=3"}) {
+		latest(s);
+	}
+	ASSERT_EQ(*latest.get(), "a=3");
+	ASSERT_EQ(*latest.get(), "b=2");
+	ASSERT_EQ(*latest.get(), "c=1");
+	ASSERT_TRUE(latest.empty());
+	ASSERT_EQ(latest.stats().conflated, 3);
+
+	// a slow consumer doesn't block the producer
+	cu::channel<int> fresh(sch, 4);
+	fresh.set_policy(cu::overflow_policy::overwrite_oldest);
+	std::vector<int> seen;
+	sch.spawn([&](auto& yield) {
+		for(int i=0; i<100; ++i) {
+			fresh(yield, i);
+		}
+		fresh.close(yield);
+	});
+	sch.spawn([&](auto& yield) {
+		for(auto& data : cu::range(yield, fresh))
+		{
+			seen.push_back(data);
+		}
+	});
+	sch.run_until_complete();
+	ASSERT_FALSE(seen.empty());
+	ASSERT_TRUE(std::is_sorted(seen.begin(), seen.end()));
+	ASSERT_EQ(seen.back(), 99);
+}
+
+TEST(ChannelTest, send_after)
+{
+	cu::parallel_scheduler sch;
+	cu::channel<int> c(sch, 10);
+	std::vector<int> order;
+	auto start = std::chrono::steady_clock::now();
+	sch.spawn([&](auto& yield) {
+		c.send_after(yield, fes::deltatime(50), 1);
+		c(yield, 2);
+		c.send_after(yield, fes::deltatime(20), 3);
+		c.close(yield);
+	});
+	sch.spawn([&](auto& yield) {
+		for(auto& data : cu::range(yield, c))
+		{
+			order.push_back(data);
+		}
+	});
+	sch.run_until_complete();
+	auto elapsed = std::chrono::steady_clock::now() - start;
+	ASSERT_EQ(order, std::vector<int>({2, 3, 1}));
+	ASSERT_GE(elapsed, std::chrono::milliseconds(45));
+
+	// the consumer sleeps until the timer, it doesn't spin on the delayed element
+	cu::channel<int> later(sch, 0);
+	later.set_policy(cu::overflow_policy::overwrite_oldest);
+	std::vector<int> received;
+	std::clock_t cpu = std::clock();
+	sch.spawn([&](auto& yield) {
+		later.send_after(yield, fes::deltatime(100), 1);
+		later(yield, 2);
+		later.close(yield);
+	});
+	sch.spawn([&](auto& yield) {
+		for(auto& data : cu::range(yield, later))
+		{
+			received.push_back(data);
+		}
+	});
+	sch.run_until_complete();
+	double cpu_ms = 1000.0 * double(std::clock() - cpu) / CLOCKS_PER_SEC;
+	ASSERT_EQ(received, std::vector<int>({1, 2}));
+	ASSERT_LT(cpu_ms, 50.0);
+}
+
+TEST(ChannelTest, priority_channel)
+{
+	cu::parallel_scheduler sch;
+	cu::priority_channel<int> urgent_first(sch, 10);
+	for(int i : {3, 1, 5, 3, 4}) {
+		urgent_first(i);
+	}
+	urgent_first.close();
+	std::vector<int> order;
+	for(auto data = urgent_first.get(); data; data = urgent_first.get())
+	{
+		order.push_back(*data);
+	}
+	ASSERT_EQ(order, std::vector<int>({5, 4, 3, 3, 1}));
+
+	// custom comparator, equal priority keeps the send order
+	auto by_length = [](const std::string& a, const std::string& b) { return a.size() < b.size(); };
+	cu::priority_channel<std::string, decltype(by_length)> longest_first(sch, 10, by_length);
+	std::vector<std::string> words;
+	sch.spawn([&](auto& yield) {
+		for(auto& s : {"bb", "a", "cc", "ddd"}) {
+			longest_first(yield, s);
+		}
+		longest_first.close(yield);
+	});
+	sch.spawn([&](auto& yield) {
+		for(auto& data : cu::range(yield, longest_first))
+		{
+			words.push_back(data);
+		}
+	});
+	sch.run_until_complete();
+	ASSERT_EQ(words, std::vector<std::string>({"ddd", "bb", "cc", "a"}));
+
+	// overwrite_oldest evicts by send order, the rest keeps the priority
+	cu::priority_channel<int> ring(sch, 3);
+	ring.set_policy(cu::overflow_policy::overwrite_oldest);
+	for(int i : {9, 1, 2, 3, 4, 5}) {
+		ring(i);
+	}
+	std::vector<int> kept;
+	for(int n=0; n<4; ++n) {
+		kept.push_back(*ring.get());
+	}
+	ASSERT_EQ(kept, std::vector<int>({5, 4, 3, 2}));
+}
+
+TEST(ChannelTest, ticker)
+{
+	cu::parallel_scheduler sch;
+	cu::ticker heartbeat(sch, fes::deltatime(10));
+	cu::after timeout(sch, fes::deltatime(30));
+	auto start = fes::high_resolution_clock();
+	std::vector<fes::marktime> ticks;
+	fes::marktime fired;
+	sch.spawn([&](auto& yield) {
+		for(auto& now : cu::range(yield, heartbeat))
+		{
+			ticks.push_back(now);
+			if(ticks.size() == 5)
+			{
+				heartbeat.stop();
+			}
+		}
+	});
+	sch.spawn([&](auto& yield) {
+		fired = *timeout.get(yield);
+		ASSERT_FALSE(timeout.get(yield));
+	});
+	sch.spawn([&](auto& yield) {
+		sch.sleep_for(yield, fes::deltatime(20));
+		ASSERT_GE(fes::high_resolution_clock() - start, fes::deltatime(20));
+	});
+	sch.run_until_complete();
+	ASSERT_EQ(ticks.size(), 5);
+	ASSERT_TRUE(std::is_sorted(ticks.begin(), ticks.end()));
+	ASSERT_GE(ticks.back() - start, fes::deltatime(50));
+	ASSERT_GE(fired - start, fes::deltatime(30));
+}
+
+namespace {
+
+	// starts the sleep ids next to the limit of int
+	struct long_running_scheduler : cu::parallel_scheduler
+	{
+		long_running_scheduler()
+		{
+			_sleep_ids = std::numeric_limits<int>::min() + 1;
+		}
+	};
+}
+
+TEST(ChannelTest, sleep_ids_wrap)
+{
+	long_running_scheduler sch;
+	int woken = 0;
+	for(int i=0; i<4; ++i)
+	{
+		sch.spawn([&, i](auto& yield) {
+			sch.sleep_for(yield, fes::deltatime(1 + i));
+			++woken;
+		});
+	}
+	sch.run_until_complete();
+	ASSERT_EQ(woken, 4);
+}
+
+TEST(ChannelTest, timing_stages)
+{
+	cu::parallel_scheduler sch;
+	cu::channel<int> events(sch, 100);
+	cu::channel<int> stable(sch, 100);
+	cu::channel<int> throttled(sch, 100);
+	cu::channel<int> sampled(sch, 100);
+	cu::channel< std::vector<int> > grouped(sch, 100);
+	cu::channel<int> events2(sch, 100);
+	cu::channel<int> events3(sch, 100);
+	cu::channel<int> events4(sch, 100);
+	sch.spawn(cu::debounce(sch, events, stable, fes::deltatime(20)));
+	sch.spawn(cu::throttle(events2, throttled, fes::deltatime(35)));
+	sch.spawn(cu::sample(sch, events3, sampled, fes::deltatime(25)));
+	sch.spawn(cu::buffer_time(sch, events4, grouped, fes::deltatime(20)));
+	// two bursts of 5
+	sch.spawn([&](auto& yield) {
+		for(int burst=0; burst<2; ++burst) {
+			for(int i=0; i<5; ++i) {
+				events(yield, burst * 10 + i);
+				events4(yield, burst * 10 + i);
+			}
+			sch.sleep_for(yield, fes::deltatime(80));
+		}
+		events.close(yield);
+		events4.close(yield);
+	});
+	// one element every 10 ms
+	sch.spawn([&](auto& yield) {
+		for(int i=0; i<10; ++i) {
+			events2(yield, i);
+			events3(yield, i);
+			sch.sleep_for(yield, fes::deltatime(10));
+		}
+		events2.close(yield);
+		events3.close(yield);
+	});
+	std::vector<int> stable_values, throttled_values, sampled_values;
+	std::vector< std::vector<int> > groups;
+	sch.spawn([&](auto& yield) {
+		for(auto& data : cu::range(yield, stable)) stable_values.push_back(data);
+	});
+	sch.spawn([&](auto& yield) {
+		for(auto& data : cu::range(yield, throttled)) throttled_values.push_back(data);
+	});
+	sch.spawn([&](auto& yield) {
+		for(auto& data : cu::range(yield, sampled)) sampled_values.push_back(data);
+	});
+	sch.spawn([&](auto& yield) {
+		for(auto& data : cu::range(yield, grouped)) groups.push_back(data);
+	});
+	sch.run_until_complete();
+
+	ASSERT_EQ(stable_values, std::vector<int>({4, 14}));
+	ASSERT_EQ(groups.size(), 2);
+	ASSERT_EQ(groups[0], std::vector<int>({0, 1, 2, 3, 4}));
+	ASSERT_EQ(groups[1], std::vector<int>({10, 11, 12, 13, 14}));
+	ASSERT_GE(throttled_values.size(), 2);
+	ASSERT_LE(throttled_values.size(), 4);
+	ASSERT_EQ(throttled_values[0], 0);
+	ASSERT_GE(sampled_values.size(), 2);
+	ASSERT_LE(sampled_values.size(), 5);
+	ASSERT_TRUE(std::is_sorted(sampled_values.begin(), sampled_values.end()));
+}
+
+TEST(ChannelTest, timing_stages_read_continuously)
+{
+	cu::parallel_scheduler sch;
+	// a small input buffer: the burst only fits if the stage reads while it waits
+	cu::channel<int> events(sch, 1);
+	cu::channel<int> stable(sch, 10);
+	sch.spawn(cu::debounce(sch, events, stable, fes::deltatime(200)));
+	fes::deltatime burst_time(0);
+	sch.spawn([&](auto& yield) {
+		auto begin = fes::high_resolution_clock();
+		for(int i=0; i<20; ++i) {
+			events(yield, i);
+		}
+		burst_time = std::chrono::duration_cast<fes::deltatime>(fes::high_resolution_clock() - begin);
+		sch.sleep_for(yield, fes::deltatime(250));
+		events.close(yield);
+	});
+	std::vector<int> stable_values;
+	sch.spawn([&](auto& yield) {
+		for(auto& data : cu::range(yield, stable)) stable_values.push_back(data);
+	});
+	sch.run_until_complete();
+	ASSERT_LT(burst_time.count(), fes::deltatime(20).count());
+	ASSERT_EQ(stable_values, std::vector<int>({19}));
+}
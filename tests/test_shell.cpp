@@ -2,6 +2,7 @@
 #include <string>
 #include <unordered_map>
 #include <gtest/gtest.h>
+#include <boost/filesystem.hpp>
 #include <teelogging/teelogging.h>
 #include <coroutine/coroutine.h>
 #include <asyncply/run.h>
@@ -16,6 +17,15 @@
 #include "../semaphore.h"
 #include "../channel.h"
 #include "../rest.h"
+#include "../parallel.h"
+#include "../block.h"
+#include "../typed.h"
+#include "../numeric.h"
+#include "../window.h"
+#include "../pipeline.h"
+#include "../sv.h"
+#include "../reader.h"
+#include "../async_io.h"
 
 
 class CoroTest : testing::Test { };
@@ -23,6 +33,32 @@ class CoroTest : testing::Test { };
 
 using namespace cu;
 
+namespace {
+
+	// unique directory in the temp dir, removed with its content
+	struct scratch_dir
+	{
+		scratch_dir()
+			: path(boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("cppunix_test_%%%%-%%%%-%%%%"))
+		{
+			boost::filesystem::create_directories(path);
+		}
+
+		~scratch_dir()
+		{
+			boost::system::error_code ec;
+			boost::filesystem::remove_all(path, ec);
+		}
+
+		std::string file(const std::string& name) const
+		{
+			return (path / name).string();
+		}
+
+		boost::filesystem::path path;
+	};
+}
+
 
 TEST(CoroTest, Test_find)
 {
@@ -190,6 +226,567 @@ TEST(CoroTest, TestCount)
 	ASSERT_EQ(result, 3) << "maybe count() is not working well";
 }
 
+TEST(CoroTest, TestParallel)
+{
+	cu::parallel_scheduler sch;
+	// slower for the first elements, so they finish last
+	auto slow_echo = []() -> ch_str::link
+	{
+		return [](auto& source, auto& yield)
+		{
+			for (auto& s : source)
+			{
+				if(s)
+				{
+					std::this_thread::sleep_for(std::chrono::milliseconds(10 - std::stoi(*s) % 10));
+				}
+				yield(s);
+			}
+		};
+	};
+	std::vector<std::string> ordered;
+	cu::channel<std::string> c1(sch, 100);
+	c1.pipeline(split(), cu::parallel(4, slow_echo()), out(ordered));
+	c1("0 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19");
+	ASSERT_EQ(ordered.size(), 20);
+	for(int i=0; i<20; ++i)
+	{
+		ASSERT_EQ(ordered[i], std::to_string(i));
+	}
+
+	std::vector<std::string> unordered;
+	cu::channel<std::string> c2(sch, 100);
+	c2.pipeline(split(), cu::parallel_unordered(4, slow_echo()), sort(), uniq(), out(unordered));
+	c2("0 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19");
+	ASSERT_EQ(unordered.size(), 20);
+}
+
+TEST(CoroTest, TestPartition)
+{
+	cu::parallel_scheduler sch;
+	auto first_word = [](const std::string& line) { return line.substr(0, line.find(' ')); };
+	std::string words;
+	for(int i=0; i<5000; ++i)
+	{
+		words += "w" + std::to_string(i % 37) + " ";
+	}
+	words.pop_back();
+
+	// per partition uniq, the same word is always in the same partition
+	std::vector<std::string> unique;
+	cu::channel<std::string> c1(sch, 100);
+	c1.pipeline(split(), cu::partition(4, first_word, uniq()), out(unique));
+	c1(words);
+	ASSERT_EQ(unique.size(), 37);
+
+	// per partition sort, merged in order by the gather
+	std::vector<std::string> sorted;
+	cu::channel<std::string> c2(sch, 10000);
+	c2.pipeline(split(), cu::partition_sorted(4, first_word, sort()), out(sorted));
+	c2(words);
+	ASSERT_EQ(sorted.size(), 5000);
+	ASSERT_TRUE(std::is_sorted(sorted.begin(), sorted.end()));
+
+	// a partition that stops early doesn't block the router
+	std::vector<std::string> heads;
+	cu::channel<std::string> c3(sch, 100);
+	c3.pipeline(split(), cu::partition(2, first_word, head(1)), out(heads));
+	c3(words);
+	ASSERT_EQ(heads.size(), 2);
+}
+
+TEST(CoroTest, TestBlock)
+{
+	scratch_dir dir;
+	std::string block_log = dir.file("block.log");
+	{
+		std::ofstream log(block_log);
+		for(int i=0; i<10000; ++i)
+		{
+			log << "line " << i << (i % 3 == 0 ? " error" : " ok") << "\n";
+		}
+	}
+	cu::parallel_scheduler sch;
+
+	int total;
+	cu::channel<std::string> c1(sch, 10);
+	c1.pipeline(cat(), grep("*error*"), cut(1), count(), out(total));
+	c1(block_log);
+
+	std::vector<std::string> counted;
+	cu::ch_block c2(sch, 10);
+	c2.pipeline(block::cat(), block::grep("*error*"), block::cut(1), block::count(), block::out(counted));
+	c2(block_log);
+	ASSERT_EQ(counted, std::vector<std::string>({std::to_string(total)}));
+	ASSERT_EQ(total, 3334);
+
+	// per-line links still work over blocks
+	std::vector<std::string> quoted;
+	cu::ch_block c3(sch, 10);
+	c3.pipeline(block::cat(), block::grep("line 9999 *"), block::lines(quote()), block::out(quoted));
+	c3(block_log);
+	ASSERT_EQ(quoted, std::vector<std::string>({"\"line 9999 error\""}));
+}
+
+TEST(CoroTest, TestStringView)
+{
+	scratch_dir dir;
+	std::string sv_log = dir.file("sv.log");
+	{
+		// lines longer than the read chunk and a last line without '\n'
+		std::ofstream log(sv_log);
+		for(int i=0; i<10000; ++i)
+		{
+			log << "  line " << i << (i % 3 == 0 ? " error " : " ok ") << std::string(i % 100, 'x') << "  \n";
+		}
+		log << std::string(200000, 'y') << " error last";
+	}
+	cu::parallel_scheduler sch;
+
+	std::vector<std::string> expected;
+	cu::channel<std::string> c1(sch, 10);
+	c1.pipeline(cat(), grep("*error*"), strip(), cut(1), out(expected), count());
+	c1(sv_log);
+
+	std::vector<std::string> fields;
+	std::string total;
+	cu::ch_sv c2(sch, 10);
+	c2.pipeline(sv::cat(), sv::grep("*error*"), sv::strip(), sv::cut(1), sv::out(fields), sv::count(), sv::out(total));
+	c2(sv_log);
+	ASSERT_EQ(fields.size(), 3335);
+	ASSERT_EQ(fields, expected);
+	ASSERT_EQ(total, "3335");
+	ASSERT_EQ(fields.back(), "error");
+
+	// the views share the buffer of the line
+	cu::line_view line("  hello world ");
+	cu::line_view word(line.sub(line.view().substr(2, 5)));
+	ASSERT_EQ(word.str(), "hello");
+	ASSERT_EQ(word.data(), line.data() + 2);
+
+	std::vector<std::string> found;
+	cu::ch_sv c3(sch, 10);
+	c3.pipeline(sv::cat(), sv::contain("line 9999 "), sv::strip(), sv::out(found));
+	c3(sv_log);
+	ASSERT_EQ(found.size(), 1);
+	ASSERT_EQ(found.front().substr(0, 17), "line 9999 error x");
+}
+
+TEST(CoroTest, TestReader)
+{
+	scratch_dir dir;
+	std::string reader_log = dir.file("reader.log");
+	std::string empty_log = dir.file("empty.log");
+	std::string not_exists_log = dir.file("not_exists.log");
+	std::vector<std::string> expected;
+	{
+		std::ofstream log(reader_log);
+		for(int i=0; i<1000; ++i)
+		{
+			std::string line = "line " + std::to_string(i) + " " + std::string(i % 37, 'x');
+			log << line << "\n";
+			expected.emplace_back(line);
+		}
+		log << "\n" << "without newline";
+		expected.emplace_back("");
+		expected.emplace_back("without newline");
+	}
+	auto collect = [](std::vector<std::string>& lines) {
+		return [&lines](const char* data, size_t length, const std::shared_ptr<const void>& owner) {
+			ASSERT_TRUE(bool(owner));
+			lines.emplace_back(data, length);
+		};
+	};
+	// lines cut by the small chunks are joined
+	for(size_t chunk : {size_t(1), size_t(7), size_t(64), size_t(1 << 20)})
+	{
+		std::vector<std::string> lines;
+		ASSERT_TRUE(cu::read_lines(reader_log, collect(lines), chunk, false));
+		ASSERT_EQ(lines, expected);
+	}
+	std::vector<std::string> mapped;
+	ASSERT_TRUE(cu::read_lines(reader_log, collect(mapped)));
+	ASSERT_EQ(mapped, expected);
+
+	std::vector<std::string> none;
+	ASSERT_FALSE(cu::read_lines(not_exists_log, collect(none)));
+	{
+		std::ofstream empty(empty_log);
+	}
+	ASSERT_TRUE(cu::read_lines(empty_log, collect(none)));
+	ASSERT_TRUE(none.empty());
+}
+
+TEST(CoroTest, TestAsyncIO)
+{
+	scratch_dir dir;
+	std::string async_files = dir.file("async_files");
+	boost::filesystem::create_directory(async_files);
+	for(int i=0; i<300; ++i)
+	{
+		std::ofstream file(async_files + "/" + std::to_string(i) + ".log");
+		for(int j=0; j<=i % 7; ++j)
+		{
+			file << "file " << i << " line " << j << (j % 2 ? " error" : " ok") << "\n";
+		}
+		if(i % 10 == 0)
+		{
+			file << "without newline";
+		}
+	}
+	cu::parallel_scheduler sch;
+
+	std::vector<std::string> expected;
+	cu::channel<std::string> c1(sch, 10);
+	c1.pipeline(find(), cat(), grep("*error*"), out(expected), count());
+	c1(async_files);
+	ASSERT_FALSE(expected.empty());
+
+	// same lines in the same order, with io_uring (if allowed) and with threads
+	for(bool uring : {true, false})
+	{
+		std::vector<std::string> strs;
+		cu::channel<std::string> c2(sch, 10);
+		c2.pipeline(find(), cat_async(16, uring), grep("*error*"), out(strs), count());
+		c2(async_files);
+		ASSERT_EQ(strs, expected);
+	}
+
+	// missing files are skipped, like cat
+	std::vector<std::string> lines;
+	cu::pipeline<std::string> p(cat_async(4));
+	p.sink([&](const std::string& s) { lines.emplace_back(s); });
+	p(async_files + "/not_exists.log");
+	p(async_files + "/10.log");
+	ASSERT_EQ(lines, (std::vector<std::string>{"file 10 line 0 ok", "file 10 line 1 error", "file 10 line 2 ok", "file 10 line 3 error", "without newline"}));
+
+	// the cpproutines sleep while their reads are in flight
+	cu::async_reader reader(sch, 8);
+	std::vector<size_t> sizes(3, 0);
+	int missing_error = 0;
+	for(int k=0; k<3; ++k)
+	{
+		sch.spawn([&, k](auto& yield) {
+			auto first = reader.submit(async_files + "/" + std::to_string(k) + ".log");
+			auto second = reader.submit(async_files + "/" + std::to_string(k + 100) + ".log");
+			reader.wait(yield, first);
+			reader.wait(yield, second);
+			sizes[k] = first->data.size() + second->data.size();
+			if(k == 0)
+			{
+				missing_error = reader.read(yield, async_files + "/not_exists.log")->error;
+			}
+		});
+	}
+	sch.run_until_complete();
+	std::cout << "async_reader backend: " << reader.backend() << std::endl;
+	for(int k=0; k<3; ++k)
+	{
+		ASSERT_EQ(sizes[k], boost::filesystem::file_size(async_files + "/" + std::to_string(k) + ".log") + boost::filesystem::file_size(async_files + "/" + std::to_string(k + 100) + ".log"));
+	}
+	ASSERT_EQ(missing_error, ENOENT);
+}
+
+TEST(CoroTest, TestPipeline)
+{
+	// no scheduler: the links run inline in the caller
+	cu::pipeline<std::string> words(split(), assert_count(3), cut(0));
+	std::vector<std::string> strs;
+	words.sink([&](const std::string& s) { strs.emplace_back(s); });
+	words("hello big world");
+	words("one two three");
+	ASSERT_EQ(strs, (std::vector<std::string>{"hello", "big", "world", "one", "two", "three"}));
+
+	ASSERT_EQ(words.collect("a b c").size(), 3);
+	ASSERT_THROW(words("a b"), std::runtime_error);
+
+	size_t errors = 0;
+	words.on_error([&](const cu::element_error&) { ++errors; });
+	strs.clear();
+	words("a b");
+	ASSERT_EQ(strs.size(), 2);
+	ASSERT_EQ(errors, 1);
+
+	cu::pipeline<std::string> total(split(), count());
+	ASSERT_EQ(total.collect("a b c d"), (std::vector<std::string>{"4"}));
+}
+
+TEST(CoroTest, TestHead)
+{
+	cu::parallel_scheduler sch;
+	size_t produced = 0;
+	auto numbers = [&](ch_str::in&, ch_str::out& yield)
+	{
+		for(int i=0; i<1000000; ++i)
+		{
+			++produced;
+			yield(std::to_string(i));
+		}
+	};
+	std::vector<std::string> strs;
+	cu::channel<std::string> c1(sch, 100);
+	c1.pipeline(numbers, head(10), out(strs));
+	c1("go");
+	ASSERT_EQ(produced, 10);
+	ASSERT_EQ(strs.size(), 10);
+	ASSERT_EQ(strs.back(), "9");
+
+	produced = 0;
+	strs.clear();
+	cu::channel<std::string> c2(sch, 100);
+	c2.pipeline(numbers, take_while([](const std::string& s) { return s.size() < 3; }), out(strs));
+	c2("go");
+	ASSERT_EQ(produced, 101);
+	ASSERT_EQ(strs.size(), 100);
+
+	produced = 0;
+	strs.clear();
+	cu::channel<std::string> c3(sch, 100);
+	c3.pipeline(numbers, grep("7*"), first(), out(strs));
+	c3("go");
+	ASSERT_EQ(produced, 8);
+	ASSERT_EQ(strs.size(), 1);
+	ASSERT_EQ(strs.front(), "7");
+}
+
+TEST(CoroTest, TestElementError)
+{
+	cu::parallel_scheduler sch;
+	std::vector<std::string> strs;
+	std::vector<cu::element_error> errors;
+	cu::channel<std::string> routed(sch, 100);
+	routed.pipeline(split(), assert_string("a"), out(strs));
+	routed.on_error([&](const cu::element_error& error) { errors.emplace_back(error); });
+	routed("a b a");
+	ASSERT_EQ(strs, (std::vector<std::string>{"a", "a"}));
+	ASSERT_EQ(errors.size(), 1);
+	ASSERT_EQ(errors.front().code, 1);
+
+	// by default the error reaches the sender as an exception
+	cu::channel<std::string> raising(sch, 100);
+	raising.enable_stats();
+	raising.pipeline(split(), assert_string("a"));
+	ASSERT_THROW(raising("a b"), std::runtime_error);
+	// nothing of the failed send was delivered
+	ASSERT_EQ(raising.stats().elements_in, 0);
+
+	// the aggregators forward the errors instead of dropping them
+	cu::channel<std::string> counting(sch, 100);
+	counting.pipeline(split(), assert_string("a"), count());
+	ASSERT_THROW(counting("a b"), std::runtime_error);
+
+	cu::typed_channel<std::string, size_t> typed_counting(sch, 100);
+	typed_counting.pipeline(split() | assert_string("a") | typed::count<std::string>());
+	ASSERT_THROW(typed_counting("a b"), std::runtime_error);
+
+	cu::ch_block blocks(sch, 100);
+	blocks.pipeline(block::lines(assert_string("a")), block::count());
+	ASSERT_THROW(blocks(cu::line_block("b")), std::runtime_error);
+
+	cu::channel<std::string> skipping(sch, 100);
+	skipping.enable_stats();
+	skipping.set_error_policy(cu::error_policy::skip);
+	skipping.pipeline(split(), assert_string("a"));
+	skipping("a b c a");
+	ASSERT_EQ(skipping.stats().errors, 2);
+	ASSERT_EQ(skipping.stats().elements_in, 2);
+
+	// links convert errors to other types without losing them
+	auto e = cu::optional<std::string>::fail(2, "bad");
+	auto n = e.template forward<int>();
+	ASSERT_FALSE(n);
+	ASSERT_TRUE(n.failed());
+	ASSERT_FALSE(n.closed());
+	ASSERT_EQ(n.get_error().message, "bad");
+	ASSERT_TRUE(cu::optional<int>(true).closed());
+}
+
+TEST(CoroTest, TestTyped)
+{
+	scratch_dir dir;
+	std::string typed_log = dir.file("typed.log");
+	{
+		std::ofstream out(typed_log);
+		out << "name id value" << std::endl;
+		for(int i=0; i<100; ++i)
+		{
+			out << "sensor " << i << " " << i * 0.5 << std::endl;
+		}
+	}
+	cu::parallel_scheduler sch;
+
+	size_t total = 0;
+	cu::typed_channel<std::string, size_t> c1(sch, 10);
+	c1.pipeline(cat() | typed::cut<int>(1) | typed::count<int>() | typed::out(total));
+	c1(typed_log);
+	ASSERT_EQ(total, 100);
+
+	using numbered = std::pair<size_t, double>;
+	cu::typed_channel<std::string, numbered> c2(sch, 10);
+	c2.pipeline(cat() | grep("sensor 9*") | typed::cut<double>(2) | typed::nl<double>());
+	std::vector<numbered> values;
+	sch.spawn([&](auto& yield) {
+		c2(yield, typed_log);
+		c2.close(yield);
+	});
+	sch.spawn([&](auto& yield) {
+		for(auto& v : cu::range(yield, c2))
+		{
+			values.emplace_back(v);
+		}
+	});
+	sch.run_until_complete();
+	ASSERT_EQ(values.size(), 11);
+	ASSERT_EQ(values[0].first, 1);
+	ASSERT_EQ(values[0].second, 4.5);
+	ASSERT_EQ(values[10].first, 11);
+	ASSERT_EQ(values[10].second, 49.5);
+
+	// the link owns its delimiter, the chain outlives the string used to build it
+	auto ids = []() {
+		std::string sep(" ");
+		return typed::cut<int>(1, sep.c_str()) | typed::count<int>();
+	}();
+	size_t counted = 0;
+	cu::typed_channel<std::string, size_t> c3(sch, 10);
+	c3.pipeline(cat() | ids | typed::out(counted));
+	c3(typed_log);
+	ASSERT_EQ(counted, 100);
+}
+
+namespace {
+
+	// n -> 0, 1, ..., n-1
+	cu::typed_link<int, int> iota_link()
+	{
+		return [](cu::pull_type< optional<int> >& source, cu::push_type< optional<int> >& yield)
+		{
+			for (auto& s : source)
+			{
+				if(s)
+				{
+					for(int i=0; i<*s; ++i)
+					{
+						yield(i);
+					}
+				}
+			}
+		};
+	}
+}
+
+TEST(CoroTest, TestNumeric)
+{
+	cu::parallel_scheduler sch;
+	auto iota = iota_link();
+
+	int total = 0;
+	cu::typed_channel<int, int> c1(sch, 10);
+	c1.pipeline(iota | numeric::sum<int>() | typed::out(total));
+	c1(1000);
+	ASSERT_EQ(total, 499500);
+
+	int low = 0;
+	cu::typed_channel<int, int> c2(sch, 10);
+	c2.pipeline(iota | numeric::map<int>([](int x) { return x * 2 - 100; }) | numeric::min<int>() | typed::out(low));
+	c2(1000);
+	ASSERT_EQ(low, -100);
+
+	double average = 0.0;
+	cu::typed_channel<int, double> c3(sch, 10);
+	c3.pipeline(iota | numeric::filter<int>([](int x) { return x % 2 == 0; }) | numeric::mean<int>() | typed::out(average));
+	c3(11);
+	ASSERT_EQ(average, 5.0);
+
+	int product = 0;
+	cu::typed_channel<int, int> c4(sch, 10);
+	c4.pipeline(iota | numeric::map<int>([](int x) { return x + 1; }) | numeric::reduce<int>(1, [](int acc, int x) { return acc * x; }) | typed::out(product));
+	c4(5);
+	ASSERT_EQ(product, 120);
+
+	int64_t big = 0;
+	cu::typed_channel<int, int64_t> c5(sch, 10);
+	c5.pipeline(iota | numeric::batch<int>(64) | numeric::batch_sum<int, int64_t>() | typed::out(big));
+	c5(100001);
+	ASSERT_EQ(big, int64_t(5000050000));
+
+	int high = 0;
+	cu::typed_channel<int, int> c6(sch, 10);
+	c6.pipeline(iota | numeric::batch<int>(7) | numeric::batch_max<int>() | typed::out(high));
+	c6(1000);
+	ASSERT_EQ(high, 999);
+
+	int lowest = -1;
+	cu::typed_channel<int, int> c7(sch, 10);
+	c7.pipeline(iota | numeric::batch<int>(7) | numeric::batch_min<int>() | typed::out(lowest));
+	c7(1000);
+	ASSERT_EQ(lowest, 0);
+
+	double batch_average = 0.0;
+	cu::typed_channel<int, double> c8(sch, 10);
+	c8.pipeline(iota | numeric::batch<int>(5) | numeric::batch_mean<int>() | typed::out(batch_average));
+	c8(11);
+	ASSERT_EQ(batch_average, 5.0);
+}
+
+TEST(CoroTest, TestWindow)
+{
+	cu::parallel_scheduler sch;
+	auto iota = iota_link();
+	auto collect = [&](auto& chan, int n)
+	{
+		using value_type = typename std::decay_t<decltype(*chan.get())>;
+		std::vector<value_type> results;
+		chan(n);
+		chan.close();
+		for(auto data = chan.get(); data; data = chan.get())
+		{
+			results.push_back(*data);
+		}
+		return results;
+	};
+
+	cu::typed_channel<int, int> sums(sch, 100);
+	sums.pipeline(iota | cu::window_tumbling<int>(4, agg::sum<int>()));
+	ASSERT_EQ(collect(sums, 10), std::vector<int>({0+1+2+3, 4+5+6+7, 8+9}));
+
+	cu::typed_channel<int, int> lows(sch, 100);
+	lows.pipeline(iota | numeric::map<int>([](int x) { return (x * 7) % 10; }) | cu::window_sliding<int>(3, 1, agg::min<int>()));
+	// 0 7 4 1 8 5 2 9 6 3
+	ASSERT_EQ(collect(lows, 10), std::vector<int>({0, 1, 1, 1, 2, 2, 2, 3}));
+
+	cu::typed_channel<int, int> highs(sch, 100);
+	highs.pipeline(iota | numeric::map<int>([](int x) { return (x * 7) % 10; }) | cu::window_sliding<int>(4, 2, agg::max<int>()));
+	ASSERT_EQ(collect(highs, 10), std::vector<int>({7, 8, 9, 9}));
+
+	cu::typed_channel<int, size_t> counts(sch, 100);
+	counts.pipeline(iota | cu::window_sliding<int>(5, 5, agg::count<int>()));
+	ASSERT_EQ(collect(counts, 12), std::vector<size_t>({5, 5}));
+
+	cu::typed_channel<int, double> p90(sch, 100);
+	p90.pipeline(iota | cu::window_tumbling<int>(1000, agg::percentile<int>(0.9, 0, 1000, 100)));
+	auto percentiles = collect(p90, 1000);
+	ASSERT_EQ(percentiles.size(), 1);
+	ASSERT_NEAR(percentiles[0], 900.0, 10.0);
+
+	// elements are milliseconds: windows of 10 ms
+	auto as_time = [](int x) { return fes::marktime(x); };
+	cu::typed_channel<int, size_t> per_time(sch, 100);
+	per_time.pipeline(iota | numeric::filter<int>([](int x) { return x % 3 == 0; }) | cu::window_tumbling_time<int>(fes::deltatime(10), as_time, agg::count<int>()));
+	// 0 3 6 9 | 12 15 18 | 21 24 27 | 30 33 36 39 | 42 45 48
+	ASSERT_EQ(collect(per_time, 50), std::vector<size_t>({4, 3, 3, 4, 3}));
+
+	cu::typed_channel<int, double> rolling(sch, 100);
+	rolling.pipeline(iota | cu::window_sliding_time<int>(fes::deltatime(20), fes::deltatime(10), as_time, agg::mean<int>()));
+	// windows ending at 10, 20, 30, 40: [0, 10) [0, 20) [10, 30) [20, 40)
+	ASSERT_EQ(collect(rolling, 40), std::vector<double>({4.5, 9.5, 19.5, 29.5}));
+
+	// empty windows are rejected when the link is built
+	ASSERT_THROW(cu::window_sliding<int>(5, 0, agg::count<int>()), std::runtime_error);
+	ASSERT_THROW(cu::window_tumbling<int>(0, agg::count<int>()), std::runtime_error);
+	ASSERT_THROW(cu::window_sliding_time<int>(fes::deltatime(10), fes::deltatime(0), as_time, agg::count<int>()), std::runtime_error);
+}
+
 TEST(CoroTest, TestUpper)
 {
 	cu::parallel_scheduler sch;
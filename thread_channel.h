@@ -0,0 +1,345 @@
+#ifndef _CU_THREAD_CHANNEL_H_
+#define _CU_THREAD_CHANNEL_H_
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <coroutine/coroutine.h>
+#include "semaphore.h"
+#include "channel.h"
+
+namespace cu {
+
+namespace detail {
+
+	// bounded multi-producer multi-consumer queue (Dmitry Vyukov)
+	template <typename T>
+	class mpmc_queue
+	{
+	public:
+		explicit mpmc_queue(size_t capacity)
+		{
+			size_t size = 2;
+			while(size < capacity)
+				size <<= 1;
+			_mask = size - 1;
+			_buffer.reset(new cell[size]);
+			for(size_t i = 0; i < size; ++i)
+			{
+				_buffer[i].sequence.store(i, std::memory_order_relaxed);
+			}
+			_enqueue_pos.store(0, std::memory_order_relaxed);
+			_dequeue_pos.store(0, std::memory_order_relaxed);
+		}
+
+		bool try_push(const T& data)
+		{
+			cell* c;
+			size_t pos = _enqueue_pos.load(std::memory_order_relaxed);
+			for(;;)
+			{
+				c = &_buffer[pos & _mask];
+				size_t seq = c->sequence.load(std::memory_order_acquire);
+				intptr_t diff = intptr_t(seq) - intptr_t(pos);
+				if(diff == 0)
+				{
+					if(_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+						break;
+				}
+				else if(diff < 0)
+				{
+					// full
+					return false;
+				}
+				else
+				{
+					pos = _enqueue_pos.load(std::memory_order_relaxed);
+				}
+			}
+			c->data = data;
+			c->sequence.store(pos + 1, std::memory_order_release);
+			return true;
+		}
+
+		bool try_pop(T& data)
+		{
+			cell* c;
+			size_t pos = _dequeue_pos.load(std::memory_order_relaxed);
+			for(;;)
+			{
+				c = &_buffer[pos & _mask];
+				size_t seq = c->sequence.load(std::memory_order_acquire);
+				intptr_t diff = intptr_t(seq) - intptr_t(pos + 1);
+				if(diff == 0)
+				{
+					if(_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+						break;
+				}
+				else if(diff < 0)
+				{
+					// empty
+					return false;
+				}
+				else
+				{
+					pos = _dequeue_pos.load(std::memory_order_relaxed);
+				}
+			}
+			data = std::move(c->data);
+			c->sequence.store(pos + _mask + 1, std::memory_order_release);
+			return true;
+		}
+
+		size_t capacity() const
+		{
+			return _mask + 1;
+		}
+
+		// hints for sleeping, exact only when nobody else is pushing or popping
+		bool empty() const
+		{
+			return _enqueue_pos.load() == _dequeue_pos.load();
+		}
+
+		bool full() const
+		{
+			return (_enqueue_pos.load() - _dequeue_pos.load()) >= capacity();
+		}
+
+	protected:
+		struct cell
+		{
+			std::atomic<size_t> sequence;
+			T data;
+		};
+
+		std::unique_ptr<cell[]> _buffer;
+		size_t _mask;
+		alignas(64) std::atomic<size_t> _enqueue_pos;
+		alignas(64) std::atomic<size_t> _dequeue_pos;
+	};
+
+	// blocks OS threads, only touches the mutex when somebody is sleeping
+	class thread_waiters
+	{
+	public:
+		thread_waiters()
+			: _count(0)
+		{
+			;
+		}
+
+		template <typename Predicate>
+		void wait(Predicate&& ready)
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			++_count;
+			_cv.wait(lock, std::forward<Predicate>(ready));
+			--_count;
+		}
+
+		void notify()
+		{
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if(_count.load() > 0)
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				_cv.notify_all();
+			}
+		}
+
+	protected:
+		std::atomic<int> _count;
+		std::mutex _mutex;
+		std::condition_variable _cv;
+	};
+
+	// parks cpproutines until another thread calls notify
+	class coroutine_waiters
+	{
+	public:
+		explicit coroutine_waiters(cu::parallel_scheduler& sche)
+			: _sche(sche)
+			, _count(0)
+			, _id(last_id++)
+		{
+			;
+		}
+
+		// true if ready() succeeded without parking
+		template <typename Predicate>
+		bool wait(cu::yield_type& yield, Predicate&& ready)
+		{
+			++_count;
+			// recheck after publishing the waiter, notify can come from any thread
+			bool done = ready();
+			if(!done)
+			{
+				_sche.wait_remote(_id);
+				yield( cu::control_type{} );
+			}
+			--_count;
+			return done;
+		}
+
+		void notify()
+		{
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if(_count.load() > 0)
+			{
+				_sche.notify_remote(_id);
+			}
+		}
+
+	protected:
+		cu::parallel_scheduler& _sche;
+		std::atomic<int> _count;
+		int _id;
+	};
+}
+
+/*
+channel between OS threads and the cpproutines of one scheduler, in both directions.
+any thread can send (send/try_send/close) or receive (get), the cpproutines
+use the versions with yield. the queue is lock-free, a side only sleeps (condition
+variable for threads, scheduler wait for cpproutines) when the queue is empty or full.
+*/
+template <typename T>
+class thread_channel
+{
+public:
+	explicit thread_channel(cu::parallel_scheduler& sche, size_t capacity = 1024)
+		: _queue(capacity)
+		, _coro_readers(sche)
+		, _coro_writers(sche)
+	{
+		;
+	}
+
+	thread_channel(const thread_channel&) = delete;
+	thread_channel& operator=(const thread_channel&) = delete;
+
+	// from any thread, false if the queue is full
+	bool try_send(const T& data)
+	{
+		return _push(optional<T>(data));
+	}
+
+	// from any thread, blocks the thread while the queue is full
+	void send(const T& data)
+	{
+		optional<T> value(data);
+		while(!_push(value))
+		{
+			_thread_writers.wait([this]() { return !_queue.full(); });
+		}
+	}
+
+	void close()
+	{
+		optional<T> mark(true);
+		while(!_push(mark))
+		{
+			_thread_writers.wait([this]() { return !_queue.full(); });
+		}
+	}
+
+	// from any thread, blocks the thread while the queue is empty
+	optional<T> get()
+	{
+		optional<T> data(true);
+		while(!_pop(data))
+		{
+			_thread_readers.wait([this]() { return !_queue.empty(); });
+		}
+		return data;
+	}
+
+	// from a cpproutine of the scheduler
+	template <typename R>
+	void operator()(cu::yield_type& yield, const R& data)
+	{
+		T element(data);
+		optional<T> value(element);
+		while(!_push(value))
+		{
+			if(_coro_writers.wait(yield, [&]() { return _push(value); }))
+				break;
+		}
+	}
+
+	void close(cu::yield_type& yield)
+	{
+		optional<T> mark(true);
+		while(!_push(mark))
+		{
+			if(_coro_writers.wait(yield, [&]() { return _push(mark); }))
+				break;
+		}
+	}
+
+	optional<T> get(cu::yield_type& yield)
+	{
+		optional<T> data(true);
+		while(!_pop(data))
+		{
+			if(_coro_readers.wait(yield, [&]() { return _pop(data); }))
+				break;
+		}
+		return data;
+	}
+
+protected:
+	bool _push(const optional<T>& data)
+	{
+		if(!_queue.try_push(data))
+		{
+			return false;
+		}
+		_coro_readers.notify();
+		_thread_readers.notify();
+		return true;
+	}
+
+	bool _pop(optional<T>& data)
+	{
+		if(!_queue.try_pop(data))
+		{
+			return false;
+		}
+		_coro_writers.notify();
+		_thread_writers.notify();
+		return true;
+	}
+
+protected:
+	detail::mpmc_queue< optional<T> > _queue;
+	detail::coroutine_waiters _coro_readers;
+	detail::coroutine_waiters _coro_writers;
+	detail::thread_waiters _thread_readers;
+	detail::thread_waiters _thread_writers;
+};
+
+template <typename T>
+auto range(cu::yield_type& yield, cu::thread_channel<T>& chan)
+{
+	return cu::pull_type<T>(
+		[&](cu::push_type<T>& own_yield) {
+			for(;;)
+			{
+				auto data = chan.get(yield);
+				if(data)
+					own_yield(*data);
+				else
+					break; // detect close
+			}
+		}
+	);
+}
+
+}
+
+#endif
+
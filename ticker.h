@@ -0,0 +1,113 @@
+#ifndef _CU_TICKER_H_
+#define _CU_TICKER_H_
+
+#include "channel.h"
+#include "parallel_scheduler.h"
+
+namespace cu {
+
+/*
+channel that receives the time every period, driven by the timers of the scheduler
+(no cpproutine is polling meanwhile). like go, a slow receiver loses ticks
+instead of accumulating them.
+
+cu::ticker heartbeat(sch, fes::deltatime(1000));
+sch.spawn([&](auto& yield) {
+	for(auto& now : cu::range(yield, heartbeat)) { ... }
+});
+*/
+class ticker : public channel<fes::marktime>
+{
+public:
+	explicit ticker(cu::parallel_scheduler& sche, fes::deltatime period)
+		: channel<fes::marktime>(sche, 1)
+		, _period(period)
+		, _stopped(false)
+	{
+		_schedule(fes::high_resolution_clock() + _period);
+	}
+
+	~ticker()
+	{
+		stop();
+	}
+
+	ticker(const ticker&) = delete;
+	ticker& operator=(const ticker&) = delete;
+
+	// no more ticks, the receivers see the channel closed
+	void stop()
+	{
+		if(_stopped)
+		{
+			return;
+		}
+		_stopped = true;
+		_sche.cancel(_timer);
+		close();
+	}
+
+protected:
+	void _schedule(fes::marktime due)
+	{
+		_timer = _sche.call_at(due, [this, due]()
+		{
+			auto now = fes::high_resolution_clock();
+			// one tick pending at most, the other slot is kept for close
+			if(_slots.size() > 1)
+			{
+				_push(now);
+			}
+			else if(_stats_enabled)
+			{
+				++_stats.dropped;
+			}
+			// skip the ticks already lost
+			auto next = due + _period;
+			while(next <= now)
+			{
+				next += _period;
+			}
+			_schedule(next);
+		});
+	}
+
+protected:
+	fes::deltatime _period;
+	bool _stopped;
+	cu::timer_id _timer;
+};
+
+/*
+channel that receives the time once, after delay, and then is closed.
+useful as timeout in cu::select.
+*/
+class after : public channel<fes::marktime>
+{
+public:
+	explicit after(cu::parallel_scheduler& sche, fes::deltatime delay)
+		: channel<fes::marktime>(sche, 1)
+	{
+		_timer = _sche.call_later(delay, [this]()
+		{
+			_push(fes::high_resolution_clock());
+			close();
+		});
+	}
+
+	~after()
+	{
+		_sche.cancel(_timer);
+	}
+
+	after(const after&) = delete;
+	after& operator=(const after&) = delete;
+
+protected:
+	cu::timer_id _timer;
+};
+
+}
+
+#endif
+
@@ -0,0 +1,262 @@
+#ifndef _CU_TIMING_H_
+#define _CU_TIMING_H_
+
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include "channel.h"
+#include "parallel_scheduler.h"
+
+namespace cu {
+
+/*
+time based stages between two channels, for bursty streams (sensors, on_change events ...).
+a link runs only while an element is sent, it can't wait for time, so these stages
+are cpproutines: sch.spawn(cu::debounce(sch, events, stable, fes::deltatime(200)));
+each stage spawns a reader that takes the input as it arrives (the producers never wait
+the timers) and emits from its own cpproutine, woken up by the reader or by a timer of
+the scheduler (call_at) at the next due time, they never poll.
+when input is closed, output is closed.
+*/
+
+namespace detail {
+
+	// wakes up one cpproutine from other cpproutines (ring) or at a due time (set)
+	class _alarm
+	{
+	public:
+		explicit _alarm(cu::parallel_scheduler& sche)
+			: _sche(sche)
+			, _id(last_id++)
+			, _armed(false)
+		{
+			;
+		}
+
+		~_alarm()
+		{
+			cancel();
+		}
+
+		_alarm(const _alarm&) = delete;
+		_alarm& operator=(const _alarm&) = delete;
+
+		void wait(cu::yield_type& yield)
+		{
+			_sche.wait(_id);
+			yield( cu::control_type{} );
+			cancel();
+		}
+
+		// lost if nobody is waiting, the waiter checks its state before wait
+		void ring()
+		{
+			_sche.notify_one(_id);
+		}
+
+		void set(fes::marktime due)
+		{
+			cancel();
+			_timer = _sche.call_at(due, [this]() { ring(); });
+			_armed = true;
+		}
+
+		void cancel()
+		{
+			if(_armed)
+			{
+				_sche.cancel(_timer);
+				_armed = false;
+			}
+		}
+
+	protected:
+		cu::parallel_scheduler& _sche;
+		int _id;
+		bool _armed;
+		cu::timer_id _timer;
+	};
+
+	// state shared by the reader and the emitter of a stage
+	template <typename State>
+	struct _timed : State
+	{
+		explicit _timed(cu::parallel_scheduler& sche)
+			: alarm(sche)
+		{
+			;
+		}
+
+		_alarm alarm;
+		bool open = true;
+	};
+
+	// spawns the reader: f(state, data) for each element, rings when f returns true or at the end
+	template <typename T, typename State, typename Function>
+	void _read_input(cu::parallel_scheduler& sche, cu::channel<T>& input, const std::shared_ptr< _timed<State> >& state, Function f)
+	{
+		sche.spawn([&input, state, f](cu::yield_type& yield) {
+			for(auto& data : cu::range(yield, input))
+			{
+				if(f(*state, data))
+				{
+					state->alarm.ring();
+				}
+			}
+			state->open = false;
+			state->alarm.ring();
+		});
+	}
+
+	template <typename T>
+	struct _latest
+	{
+		bool any = false;
+		T data;
+		fes::marktime due;
+	};
+
+	template <typename T>
+	struct _group
+	{
+		std::vector<T> data;
+		fes::marktime due;
+	};
+}
+
+// emits the last element of a burst, once input is quiet for d
+template <typename T>
+auto debounce(cu::parallel_scheduler& sche, cu::channel<T>& input, cu::channel<T>& output, fes::deltatime d)
+{
+	return [&sche, &input, &output, d](cu::yield_type& yield)
+	{
+		auto state = std::make_shared< detail::_timed< detail::_latest<T> > >(sche);
+		detail::_read_input(sche, input, state, [d](detail::_latest<T>& burst, const T& data) {
+			bool first = !burst.any;
+			burst.any = true;
+			burst.data = data;
+			burst.due = fes::high_resolution_clock() + d;
+			// the emitter sleeps until the first due, later ones only move it
+			return first;
+		});
+		for(;;)
+		{
+			if(state->any && (!state->open || (fes::high_resolution_clock() >= state->due)))
+			{
+				state->any = false;
+				output(yield, state->data);
+				continue;
+			}
+			if(!state->open)
+			{
+				break;
+			}
+			if(state->any)
+			{
+				state->alarm.set(state->due);
+			}
+			state->alarm.wait(yield);
+		}
+		output.close(yield);
+	};
+}
+
+// emits an element and drops the next ones until interval is elapsed (leading edge)
+template <typename T>
+auto throttle(cu::channel<T>& input, cu::channel<T>& output, fes::deltatime interval)
+{
+	return [&input, &output, interval](cu::yield_type& yield)
+	{
+		auto next = fes::high_resolution_clock();
+		for(auto& data : cu::range(yield, input))
+		{
+			auto now = fes::high_resolution_clock();
+			if(now >= next)
+			{
+				output(yield, data);
+				next = now + interval;
+			}
+		}
+		output.close(yield);
+	};
+}
+
+// every period, emits the last element received in that period (nothing if there was none)
+template <typename T>
+auto sample(cu::parallel_scheduler& sche, cu::channel<T>& input, cu::channel<T>& output, fes::deltatime period)
+{
+	return [&sche, &input, &output, period](cu::yield_type& yield)
+	{
+		auto state = std::make_shared< detail::_timed< detail::_latest<T> > >(sche);
+		detail::_read_input(sche, input, state, [](detail::_latest<T>& last, const T& data) {
+			last.any = true;
+			last.data = data;
+			return false;
+		});
+		auto next = fes::high_resolution_clock() + period;
+		while(state->open)
+		{
+			state->alarm.set(next);
+			state->alarm.wait(yield);
+			auto now = fes::high_resolution_clock();
+			if(!state->open || (now >= next))
+			{
+				if(state->any)
+				{
+					state->any = false;
+					output(yield, state->data);
+				}
+				next += period;
+				if(next <= now)
+				{
+					// a slow consumer doesn't make a burst of samples
+					next = now + period;
+				}
+			}
+		}
+		output.close(yield);
+	};
+}
+
+// groups the elements received in window (since the first of the group) in one vector
+template <typename T>
+auto buffer_time(cu::parallel_scheduler& sche, cu::channel<T>& input, cu::channel< std::vector<T> >& output, fes::deltatime window)
+{
+	return [&sche, &input, &output, window](cu::yield_type& yield)
+	{
+		auto state = std::make_shared< detail::_timed< detail::_group<T> > >(sche);
+		detail::_read_input(sche, input, state, [window](detail::_group<T>& group, const T& data) {
+			bool first = group.data.empty();
+			if(first)
+			{
+				group.due = fes::high_resolution_clock() + window;
+			}
+			group.data.emplace_back(data);
+			return first;
+		});
+		for(;;)
+		{
+			if(!state->data.empty() && (!state->open || (fes::high_resolution_clock() >= state->due)))
+			{
+				std::vector<T> group;
+				group.swap(state->data);
+				output(yield, group);
+				continue;
+			}
+			if(!state->open)
+			{
+				break;
+			}
+			if(!state->data.empty())
+			{
+				state->alarm.set(state->due);
+			}
+			state->alarm.wait(yield);
+		}
+		output.close(yield);
+	};
+}
+
+}
+
+#endif
@@ -0,0 +1,278 @@
+#ifndef _CU_TYPED_H_
+#define _CU_TYPED_H_
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <type_traits>
+#include <functional>
+#include <boost/tokenizer.hpp>
+#include <boost/lexical_cast.hpp>
+#include "channel.h"
+#include "shell.h"
+
+namespace cu {
+
+/*
+link that changes the type of the elements: In -> Out.
+typed links are chained with operator|, a link of the same type
+(ch_str::link, ...) can be mixed in the chain:
+
+typed_channel<std::string, size_t> c(sch, 10);
+c.pipeline(cat() | typed::cut<int>(1) | typed::count<int>());
+*/
+template <typename In, typename Out>
+class typed_link
+{
+public:
+	using in = cu::pull_type< optional<In> >;
+	using out = cu::push_type< optional<Out> >;
+
+	typed_link()
+	{
+		;
+	}
+
+	template <typename Function, typename = std::enable_if_t< !std::is_same<std::decay_t<Function>, typed_link>::value > >
+	typed_link(Function&& f)
+		: _f(std::forward<Function>(f))
+	{
+		;
+	}
+
+	void operator()(in& source, out& yield) const
+	{
+		_f(source, yield);
+	}
+
+	explicit operator bool() const
+	{
+		return bool(_f);
+	}
+
+protected:
+	std::function<void(in&, out&)> _f;
+};
+
+namespace detail {
+
+	// nested generator: the output of a is the source of b
+	template <typename A, typename B, typename C>
+	typed_link<A, C> _chain(const typed_link<A, B>& a, const typed_link<B, C>& b)
+	{
+		return [a, b](typename typed_link<A, C>::in& source, typename typed_link<A, C>::out& yield)
+		{
+			cu::pull_type< optional<B> > middle(
+				[&](cu::push_type< optional<B> >& middle_yield)
+				{
+					a(source, middle_yield);
+				}
+			);
+			b(middle, yield);
+		};
+	}
+
+	template <typename In, typename Out>
+	std::vector< optional<Out> > _typed_pipe(const typed_link<In, Out>& f, const In& input)
+	{
+		std::vector< optional<Out> > output;
+		cu::pull_type< optional<In> > source(
+			[&](cu::push_type< optional<In> >& yield)
+			{
+				yield(optional<In>(input));
+			}
+		);
+		cu::push_type< optional<Out> > sink(
+			[&](cu::pull_type< optional<Out> >& results)
+			{
+				for (auto& s : results)
+				{
+					if(s || s.failed())
+					{
+						output.emplace_back(s);
+					}
+				}
+			}
+		);
+		f(source, sink);
+		return output;
+	}
+}
+
+template <typename A, typename B, typename C>
+typed_link<A, C> operator|(const typed_link<A, B>& a, const typed_link<B, C>& b)
+{
+	return detail::_chain(a, b);
+}
+
+template <typename A, typename C>
+typed_link<A, C> operator|(const cu::link< optional<A> >& a, const typed_link<A, C>& b)
+{
+	return detail::_chain(typed_link<A, A>(a), b);
+}
+
+template <typename A, typename C>
+typed_link<A, C> operator|(const typed_link<A, C>& a, const cu::link< optional<C> >& b)
+{
+	return detail::_chain(a, typed_link<C, C>(b));
+}
+
+// A can't be deduced from two untyped links, only the shell links start a chain
+inline typed_link<std::string, std::string> operator|(const ch_str::link& a, const ch_str::link& b)
+{
+	return detail::_chain(typed_link<std::string, std::string>(a), typed_link<std::string, std::string>(b));
+}
+
+/*
+channel of Out fed with In: the pipeline does the conversion.
+consumers see a normal channel<Out> (get, range, ...).
+*/
+template <typename In, typename Out>
+class typed_channel : public channel<Out>
+{
+public:
+	explicit typed_channel(cu::parallel_scheduler& sche, size_t buffer = 0)
+		: channel<Out>(sche, buffer)
+	{
+		;
+	}
+
+	void pipeline(const typed_link<In, Out>& f)
+	{
+		_typed = f;
+	}
+
+	void operator()(const In& data)
+	{
+		auto output = pipe(data);
+		this->_raise_before_push(output);
+		for(auto& e : output)
+		{
+			this->_push(e);
+		}
+	}
+
+	void operator()(cu::yield_type& yield, const In& data)
+	{
+		auto output = pipe(data);
+		this->_raise_before_push(output);
+		for(auto& e : output)
+		{
+			this->_push(yield, e);
+		}
+	}
+
+	std::vector< optional<Out> > pipe(const In& data)
+	{
+		assert(_typed && "typed_channel without pipeline");
+		return detail::_typed_pipe(_typed, data);
+	}
+
+protected:
+	typed_link<In, Out> _typed;
+};
+
+// typed versions of the builtins, no std::to_string / std::stoi between stages
+namespace typed {
+
+template <typename T>
+typed_link<T, size_t> count()
+{
+	return [](cu::pull_type< optional<T> >& source, cu::push_type< optional<size_t> >& yield)
+	{
+		size_t total = 0;
+		for (auto& s : source)
+		{
+			if(s)
+			{
+				++total;
+			}
+			else if(s.failed())
+			{
+				yield(s.template forward<size_t>());
+			}
+		}
+		yield(total);
+	};
+}
+
+template <typename T>
+typed_link<T, std::pair<size_t, T> > nl(size_t starting = 1)
+{
+	using numbered = std::pair<size_t, T>;
+	return [=](cu::pull_type< optional<T> >& source, cu::push_type< optional<numbered> >& yield)
+	{
+		size_t lineno = starting;
+		for (auto& s : source)
+		{
+			if(s)
+			{
+				numbered line(lineno++, *s);
+				yield(line);
+			}
+			else
+			{
+				yield(s.template forward<numbered>());
+			}
+		}
+	};
+}
+
+// field-th token parsed as Out, lines without a valid field are skipped
+template <typename Out>
+typed_link<std::string, Out> cut(int field, const char* delim = " ")
+{
+	// owned: the link can outlive the string of the caller
+	std::string separators(delim);
+	return [field, separators](ch_str::in& source, cu::push_type< optional<Out> >& yield)
+	{
+		typedef boost::tokenizer<boost::char_separator<char>> tokenizer;
+		for (auto& s : source)
+		{
+			if(s)
+			{
+				int i = 0;
+				for (auto& t : tokenizer(*s, boost::char_separator<char>(separators.c_str())))
+				{
+					if (i++ == field)
+					{
+						Out value;
+						if(boost::conversion::try_lexical_convert(t, value))
+						{
+							yield(value);
+						}
+						break;
+					}
+				}
+			}
+			else
+			{
+				yield(s.template forward<Out>());
+			}
+		}
+	};
+}
+
+// stores the last element
+template <typename T>
+typed_link<T, T> out(T& result)
+{
+	return [&result](cu::pull_type< optional<T> >& source, cu::push_type< optional<T> >& yield)
+	{
+		for (auto& s : source)
+		{
+			if(s)
+			{
+				result = *s;
+			}
+			yield(s);
+		}
+	};
+}
+
+}
+
+}
+
+#endif
+
@@ -0,0 +1,363 @@
+#ifndef _CU_WINDOW_H_
+#define _CU_WINDOW_H_
+
+#include <deque>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+#include "channel.h"
+#include "typed.h"
+
+namespace cu {
+
+/*
+incremental aggregators for the windows, O(1) per element:
+
+struct my_agg
+{
+	using result_type = ...;
+	void push(const T& data);	// data enters the window
+	void pop(const T& data);	// the oldest element (data) leaves the window
+	result_type value() const;	// only called with a non empty window
+	void clear();
+};
+*/
+namespace agg {
+
+template <typename T>
+struct sum
+{
+	using result_type = T;
+
+	void push(const T& data) { _total += data; }
+	void pop(const T& data) { _total -= data; }
+	result_type value() const { return _total; }
+	void clear() { _total = T(); }
+
+protected:
+	T _total = T();
+};
+
+template <typename T>
+struct count
+{
+	using result_type = size_t;
+
+	void push(const T&) { ++_total; }
+	void pop(const T&) { --_total; }
+	result_type value() const { return _total; }
+	void clear() { _total = 0; }
+
+protected:
+	size_t _total = 0;
+};
+
+template <typename T>
+struct mean
+{
+	using result_type = double;
+
+	void push(const T& data) { _total += data; ++_n; }
+	void pop(const T& data) { _total -= data; --_n; }
+	result_type value() const { return _total / _n; }
+	void clear() { _total = 0.0; _n = 0; }
+
+protected:
+	double _total = 0.0;
+	size_t _n = 0;
+};
+
+// monotonic deque: the front is the best of the window, amortized O(1)
+template <typename T, typename Better>
+struct extreme
+{
+	using result_type = T;
+
+	void push(const T& data)
+	{
+		while(!_candidates.empty() && !Better()(_candidates.back().second, data))
+		{
+			_candidates.pop_back();
+		}
+		_candidates.emplace_back(_pushed++, data);
+	}
+
+	void pop(const T&)
+	{
+		if(!_candidates.empty() && (_candidates.front().first == _popped))
+		{
+			_candidates.pop_front();
+		}
+		++_popped;
+	}
+
+	result_type value() const
+	{
+		return _candidates.front().second;
+	}
+
+	void clear()
+	{
+		_candidates.clear();
+		_pushed = _popped = 0;
+	}
+
+protected:
+	// (position in the stream, value)
+	std::deque< std::pair<uint64_t, T> > _candidates;
+	uint64_t _pushed = 0;
+	uint64_t _popped = 0;
+};
+
+template <typename T>
+using min = extreme< T, std::less<T> >;
+
+template <typename T>
+using max = extreme< T, std::greater<T> >;
+
+// approximated percentile (q in [0, 1]) with a fixed histogram over [low, high)
+template <typename T>
+struct percentile
+{
+	using result_type = double;
+
+	explicit percentile(double q, T low, T high, size_t buckets = 128)
+		: _q(q)
+		, _low(double(low))
+		, _width((double(high) - double(low)) / buckets)
+		, _counts(buckets, 0)
+		, _total(0)
+	{
+		;
+	}
+
+	void push(const T& data) { ++_counts[_bucket(data)]; ++_total; }
+	void pop(const T& data) { --_counts[_bucket(data)]; --_total; }
+
+	result_type value() const
+	{
+		size_t rank = std::min(size_t(_q * _total), _total - 1);
+		size_t seen = 0;
+		for(size_t i = 0; i < _counts.size(); ++i)
+		{
+			seen += _counts[i];
+			if(seen > rank)
+			{
+				// center of the bucket
+				return _low + (i + 0.5) * _width;
+			}
+		}
+		return _low + _counts.size() * _width;
+	}
+
+	void clear()
+	{
+		std::fill(_counts.begin(), _counts.end(), 0);
+		_total = 0;
+	}
+
+protected:
+	size_t _bucket(const T& data) const
+	{
+		double i = (double(data) - _low) / _width;
+		if(i < 0.0)
+			return 0;
+		return std::min(size_t(i), _counts.size() - 1);
+	}
+
+protected:
+	double _q;
+	double _low;
+	double _width;
+	std::vector<size_t> _counts;
+	size_t _total;
+};
+
+}
+
+namespace detail {
+
+	// a window of 0 elements (or 0 time) would divide by zero in every element
+	inline void _check_window(bool valid, const char* message)
+	{
+		if(!valid)
+		{
+			throw std::runtime_error(message);
+		}
+	}
+}
+
+// one result every size elements, the last window can be incomplete
+template <typename T, typename Agg>
+typed_link<T, typename Agg::result_type> window_tumbling(size_t size, Agg agg)
+{
+	detail::_check_window(size > 0, "window_tumbling: size must be > 0");
+	using result_type = typename Agg::result_type;
+	return [=](cu::pull_type< optional<T> >& source, cu::push_type< optional<result_type> >& yield)
+	{
+		Agg window(agg);
+		size_t n = 0;
+		for (auto& s : source)
+		{
+			if(s)
+			{
+				window.push(*s);
+				if(++n == size)
+				{
+					result_type result(window.value());
+					yield(result);
+					window.clear();
+					n = 0;
+				}
+			}
+			else
+			{
+				yield(s.template forward<result_type>());
+			}
+		}
+		if(n > 0)
+		{
+			result_type result(window.value());
+			yield(result);
+		}
+	};
+}
+
+// one result every step elements, over the last size elements (once there are size)
+template <typename T, typename Agg>
+typed_link<T, typename Agg::result_type> window_sliding(size_t size, size_t step, Agg agg)
+{
+	detail::_check_window((size > 0) && (step > 0), "window_sliding: size and step must be > 0");
+	using result_type = typename Agg::result_type;
+	return [=](cu::pull_type< optional<T> >& source, cu::push_type< optional<result_type> >& yield)
+	{
+		Agg window(agg);
+		std::deque<T> values;
+		size_t seen = 0;
+		for (auto& s : source)
+		{
+			if(s)
+			{
+				values.emplace_back(*s);
+				window.push(*s);
+				if(values.size() > size)
+				{
+					window.pop(values.front());
+					values.pop_front();
+				}
+				if((++seen >= size) && ((seen - size) % step == 0))
+				{
+					result_type result(window.value());
+					yield(result);
+				}
+			}
+			else
+			{
+				yield(s.template forward<result_type>());
+			}
+		}
+	};
+}
+
+// windows by time: [k * size, (k + 1) * size), time_fn(element) -> fes::marktime (event time)
+template <typename T, typename TimeFn, typename Agg>
+typed_link<T, typename Agg::result_type> window_tumbling_time(fes::deltatime size, TimeFn time_fn, Agg agg)
+{
+	detail::_check_window(size.count() > 0, "window_tumbling_time: size must be > 0");
+	using result_type = typename Agg::result_type;
+	return [=](cu::pull_type< optional<T> >& source, cu::push_type< optional<result_type> >& yield)
+	{
+		Agg window(agg);
+		bool empty = true;
+		int64_t current = 0;
+		for (auto& s : source)
+		{
+			if(s)
+			{
+				int64_t bucket = time_fn(*s).count() / size.count();
+				if(!empty && (bucket != current))
+				{
+					result_type result(window.value());
+					yield(result);
+					window.clear();
+					empty = true;
+				}
+				current = bucket;
+				window.push(*s);
+				empty = false;
+			}
+			else
+			{
+				yield(s.template forward<result_type>());
+			}
+		}
+		if(!empty)
+		{
+			result_type result(window.value());
+			yield(result);
+		}
+	};
+}
+
+// every step of time, one result over the elements of the last size of time
+template <typename T, typename TimeFn, typename Agg>
+typed_link<T, typename Agg::result_type> window_sliding_time(fes::deltatime size, fes::deltatime step, TimeFn time_fn, Agg agg)
+{
+	detail::_check_window((size.count() > 0) && (step.count() > 0), "window_sliding_time: size and step must be > 0");
+	using result_type = typename Agg::result_type;
+	return [=](cu::pull_type< optional<T> >& source, cu::push_type< optional<result_type> >& yield)
+	{
+		Agg window(agg);
+		std::deque< std::pair<fes::marktime, T> > values;
+		bool started = false;
+		fes::marktime next_emit;
+		auto emit_until = [&](fes::marktime end)
+		{
+			while(!values.empty() && (values.front().first < end - size))
+			{
+				window.pop(values.front().second);
+				values.pop_front();
+			}
+			if(!values.empty())
+			{
+				result_type result(window.value());
+				yield(result);
+			}
+		};
+		for (auto& s : source)
+		{
+			if(s)
+			{
+				fes::marktime t = time_fn(*s);
+				if(!started)
+				{
+					// first boundary after the first element
+					next_emit = fes::marktime((t.count() / step.count() + 1) * step.count());
+					started = true;
+				}
+				while(t >= next_emit)
+				{
+					emit_until(next_emit);
+					next_emit += step;
+				}
+				values.emplace_back(t, *s);
+				window.push(*s);
+			}
+			else
+			{
+				yield(s.template forward<result_type>());
+			}
+		}
+		if(started)
+		{
+			emit_until(next_emit);
+		}
+	};
+}
+
+}
+
+#endif
+